@@ -0,0 +1,427 @@
+// Throughput and latency of the basic node operations, on an offline node in
+// a temporary repository, of transfers between two nodes in this process, and
+// the time it takes to start a node. Results are printed to stdout as JSON.
+//
+// `cat_cached` serves every `cat` from the node's in-process cache, so it
+// measures what a call costs on the C++ side alone: initiating the operation
+// and getting its result to the handler.
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <asio_ipfs.h>
+#include <boost/program_options.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/spawn.hpp>
+#include <ftw.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+namespace chrono = std::chrono;
+
+using Clock = chrono::steady_clock;
+using asio_ipfs::node;
+
+struct Result {
+    string op;
+    size_t size;
+    size_t concurrency;
+    size_t ops;
+    double seconds;
+    // Microseconds, sorted.
+    vector<double> latencies;
+};
+
+static vector<size_t> parse_list(const string& s)
+{
+    vector<size_t> ret;
+    std::stringstream ss(s);
+    string item;
+
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) ret.push_back(std::stoull(item));
+    }
+
+    return ret;
+}
+
+static vector<string> parse_names(const string& s)
+{
+    vector<string> ret;
+    std::stringstream ss(s);
+    string item;
+
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) ret.push_back(item);
+    }
+
+    return ret;
+}
+
+static node::datastore_type parse_datastore(const string& s)
+{
+    if (s == "flatfs")  return node::datastore_type::flatfs;
+    if (s == "leveldb") return node::datastore_type::leveldb;
+    if (s == "badger")  return node::datastore_type::badger;
+    if (s == "memory")  return node::datastore_type::memory;
+    throw std::invalid_argument("unknown datastore: " + s);
+}
+
+static node::identity_type parse_identity(const string& s)
+{
+    if (s == "rsa")     return node::identity_type::rsa;
+    if (s == "ed25519") return node::identity_type::ed25519;
+    throw std::invalid_argument("unknown identity type: " + s);
+}
+
+static double percentile(const vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t i = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+    return sorted[i];
+}
+
+static vector<string> random_payloads(size_t count, size_t size, std::mt19937_64& rng)
+{
+    vector<string> ret(count);
+
+    for (auto& p : ret) {
+        p.resize(size);
+        for (auto& c : p) c = char(rng());
+    }
+
+    return ret;
+}
+
+/*
+ * Runs `op(i, yield)` for i in [0, count) from `concurrency` coroutines and
+ * records the latency of every call.
+ */
+template<class Op>
+static Result run( asio::io_service& ios
+                 , string name
+                 , size_t size
+                 , size_t concurrency
+                 , size_t count
+                 , Op op
+                 , asio::yield_context yield)
+{
+    Result r{std::move(name), size, concurrency, count, 0, {}};
+    r.latencies.reserve(count);
+
+    size_t next = 0;
+    size_t running = concurrency;
+
+    asio::steady_timer all_done(ios, Clock::time_point::max());
+
+    auto start = Clock::now();
+
+    for (size_t w = 0; w < concurrency; ++w) {
+        asio::spawn(ios, [&] (asio::yield_context yield) {
+            while (next < count) {
+                size_t i = next++;
+                auto t = Clock::now();
+                op(i, yield);
+                chrono::duration<double, std::micro> d = Clock::now() - t;
+                r.latencies.push_back(d.count());
+            }
+
+            if (--running == 0) all_done.cancel();
+        });
+    }
+
+    sys::error_code ec;
+    all_done.async_wait(yield[ec]);
+
+    r.seconds = chrono::duration<double>(Clock::now() - start).count();
+    std::sort(r.latencies.begin(), r.latencies.end());
+    return r;
+}
+
+/*
+ * Builds `count` nodes one after another, each in a new repository, and then
+ * once more on each of the existing repositories. The former includes
+ * creating the repository and the node's identity.
+ */
+static vector<Result> run_startup( asio::io_service& ios
+                                 , const string& repo
+                                 , node::config cfg
+                                 , size_t count
+                                 , asio::yield_context yield)
+{
+    Result create{"startup_create", 0, 1, count, 0, {}};
+    Result open{"startup_open", 0, 1, count, 0, {}};
+
+    auto build = [&] (Result& r, const string& path) {
+        auto t = Clock::now();
+        auto n = node::build(ios, path, cfg, yield);
+        chrono::duration<double, std::micro> d = Clock::now() - t;
+        r.latencies.push_back(d.count());
+        r.seconds += d.count() / 1e6;
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        string path = repo + "/startup-" + std::to_string(i);
+        build(create, path);
+        build(open, path);
+    }
+
+    std::sort(create.latencies.begin(), create.latencies.end());
+    std::sort(open.latencies.begin(), open.latencies.end());
+
+    return {create, open};
+}
+
+/*
+ * Two online nodes which know of no other peers, the second one connected to
+ * the first one over loopback. Content added to the first one can only get
+ * to the second one through bitswap.
+ */
+static std::pair<std::unique_ptr<node>, std::unique_ptr<node>>
+build_pair( asio::io_service& ios
+          , const string& repo
+          , node::config cfg
+          , asio::yield_context yield)
+{
+    cfg.online    = true;
+    cfg.bootstrap = false;
+
+    auto a = node::build(ios, repo + "/bitswap-a", cfg, yield);
+    auto b = node::build(ios, repo + "/bitswap-b", cfg, yield);
+
+    for (auto& addr : a->swarm_addresses()) {
+        if (addr.compare(0, 15, "/ip4/127.0.0.1/") != 0) continue;
+        b->connect(addr, yield);
+        return {std::move(a), std::move(b)};
+    }
+
+    throw std::runtime_error("Node doesn't listen on the loopback interface");
+}
+
+static void print_json(std::ostream& os, const string& datastore, const vector<Result>& results)
+{
+    os << "{\n"
+       << "  \"datastore\": \"" << datastore << "\",\n"
+       << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+        double ops_s = r.seconds > 0 ? r.ops / r.seconds : 0;
+
+        os << (i ? "," : "") << "\n    {"
+           << "\"op\": \"" << r.op << "\", "
+           << "\"size\": " << r.size << ", "
+           << "\"concurrency\": " << r.concurrency << ", "
+           << "\"ops\": " << r.ops << ", "
+           << "\"seconds\": " << r.seconds << ", "
+           << "\"ops_per_sec\": " << ops_s << ", "
+           << "\"mb_per_sec\": " << ops_s * r.size / 1e6 << ", "
+           << "\"latency_us\": {"
+           <<     "\"p50\": "  << percentile(r.latencies, 0.5)   << ", "
+           <<     "\"p99\": "  << percentile(r.latencies, 0.99)  << ", "
+           <<     "\"p999\": " << percentile(r.latencies, 0.999)
+           << "}}";
+    }
+
+    os << "\n  ]\n}" << endl;
+}
+
+static int remove_entry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return ::remove(path);
+}
+
+int main(int argc, const char** argv)
+{
+    namespace po = boost::program_options;
+
+    po::options_description desc("Options");
+
+    desc.add_options()
+        ("help", "Produce this help message")
+        ("ops", po::value<size_t>()->default_value(200),
+         "Operations per configuration")
+        ("sizes", po::value<string>()->default_value("1024,65536,1048576"),
+         "Comma separated payload sizes in bytes")
+        ("concurrency", po::value<string>()->default_value("1,8,64"),
+         "Comma separated numbers of concurrent operations")
+        ("bench", po::value<string>()->default_value("add,cat,calculate_cid,pin"),
+         "Comma separated operations to measure: add, cat, cat_cached, "
+         "calculate_cid, pin, startup and bitswap")
+        ("datastore", po::value<string>()->default_value("flatfs"),
+         "Repository backend: flatfs, leveldb, badger or memory")
+        ("startups", po::value<size_t>()->default_value(10),
+         "Nodes to start in the startup benchmark")
+        ("identity", po::value<string>()->default_value("rsa"),
+         "Key type of new nodes: rsa or ed25519")
+        ("online", po::value<bool>()->default_value(false),
+         "Whether nodes connect to the network")
+        ("lazy-bootstrap", po::value<bool>()->default_value(false),
+         "Only bootstrap once an operation needs the network")
+        ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        cout << desc << endl;
+        return 0;
+    }
+
+    size_t ops          = vm["ops"].as<size_t>();
+    auto sizes          = parse_list(vm["sizes"].as<string>());
+    auto concurrencies  = parse_list(vm["concurrency"].as<string>());
+    auto benches        = parse_names(vm["bench"].as<string>());
+    string datastore    = vm["datastore"].as<string>();
+    size_t startups     = vm["startups"].as<size_t>();
+
+    for (auto& bench : benches) {
+        if (bench != "add" && bench != "cat" && bench != "cat_cached"
+                && bench != "calculate_cid" && bench != "pin"
+                && bench != "startup" && bench != "bitswap") {
+            cerr << "Unknown benchmark: " << bench << endl;
+            return 1;
+        }
+    }
+
+    node::config cfg;
+    cfg.online         = vm["online"].as<bool>();
+    cfg.datastore      = parse_datastore(datastore);
+    cfg.identity       = parse_identity(vm["identity"].as<string>());
+    cfg.lazy_bootstrap = vm["lazy-bootstrap"].as<bool>();
+    // Several nodes run in this process, they can't all listen on the API
+    // address.
+    cfg.http_api       = false;
+
+    char repo_template[] = "/tmp/asio-ipfs-bench-XXXXXX";
+
+    if (!mkdtemp(repo_template)) {
+        cerr << "Failed to create a temporary repository" << endl;
+        return 1;
+    }
+
+    string repo = repo_template;
+
+    asio::io_service ios;
+    vector<Result> results;
+    std::mt19937_64 rng(0);
+
+    asio::spawn(ios, [&](asio::yield_context yield) {
+            for (auto& bench : benches) {
+                if (bench != "startup") continue;
+                auto rs = run_startup(ios, repo, cfg, startups, yield);
+                results.insert(results.end(), rs.begin(), rs.end());
+            }
+
+            auto n = node::build(ios, repo + "/ops", cfg, yield);
+
+            std::pair<std::unique_ptr<node>, std::unique_ptr<node>> pair;
+
+            if (std::count(benches.begin(), benches.end(), "bitswap")) {
+                pair = build_pair(ios, repo, cfg, yield);
+            }
+
+            std::unique_ptr<node> cached;
+
+            if (std::count(benches.begin(), benches.end(), "cat_cached") && !sizes.empty()) {
+                auto c = cfg;
+                // Room for every payload of the largest size.
+                c.cat_cache_size
+                    = 2 * ops * *std::max_element(sizes.begin(), sizes.end());
+                cached = node::build(ios, repo + "/cached", c, yield);
+            }
+
+            for (auto& bench : benches)
+            for (auto size : sizes)
+            for (auto concurrency : concurrencies) {
+                if (bench == "startup") continue;
+
+                auto payloads = random_payloads(ops, size, rng);
+
+                if (bench == "add") {
+                    results.push_back(run(ios, bench, size, concurrency, ops,
+                        [&] (size_t i, asio::yield_context yield) {
+                            n->add(payloads[i], yield);
+                        }, yield));
+                }
+                else if (bench == "calculate_cid") {
+                    results.push_back(run(ios, bench, size, concurrency, ops,
+                        [&] (size_t i, asio::yield_context yield) {
+                            std::function<void()> cancel;
+                            n->calculate_cid(payloads[i], cancel, yield);
+                        }, yield));
+                }
+                else if (bench == "bitswap") {
+                    vector<string> cids;
+                    cids.reserve(ops);
+
+                    for (auto& p : payloads) {
+                        cids.push_back(pair.first->add(p, yield));
+                    }
+
+                    results.push_back(run(ios, bench, size, concurrency, ops,
+                        [&] (size_t i, asio::yield_context yield) {
+                            pair.second->cat(cids[i], yield);
+                        }, yield));
+                }
+                else if (bench == "cat_cached") {
+                    vector<string> cids;
+                    cids.reserve(ops);
+
+                    // The first `cat` of each CID fills the cache.
+                    for (auto& p : payloads) {
+                        cids.push_back(cached->add(p, yield));
+                        cached->cat(cids.back(), yield);
+                    }
+
+                    results.push_back(run(ios, bench, size, concurrency, ops,
+                        [&] (size_t i, asio::yield_context yield) {
+                            cached->cat(cids[i], yield);
+                        }, yield));
+                }
+                else {
+                    vector<string> cids;
+                    cids.reserve(ops);
+
+                    for (auto& p : payloads) {
+                        cids.push_back(n->add(p, yield));
+                    }
+
+                    if (bench == "cat") {
+                        results.push_back(run(ios, bench, size, concurrency, ops,
+                            [&] (size_t i, asio::yield_context yield) {
+                                n->cat(cids[i], yield);
+                            }, yield));
+                    } else {
+                        // Content is pinned by `add`, measure pinning
+                        // content which is local but not pinned.
+                        n->unpin_many(cids, yield);
+
+                        results.push_back(run(ios, bench, size, concurrency, ops,
+                            [&] (size_t i, asio::yield_context yield) {
+                                n->pin(cids[i], yield);
+                            }, yield));
+                    }
+                }
+            }
+        });
+
+    ios.run();
+
+    print_json(cout, datastore, results);
+
+    nftw(repo.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    return 0;
+}
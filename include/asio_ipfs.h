@@ -2,3 +2,4 @@
 
 #include <asio_ipfs/node.h>
 #include <asio_ipfs/error.h>
+#include <asio_ipfs/calculate_cid.h>
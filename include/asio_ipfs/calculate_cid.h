@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <boost/utility/string_view.hpp>
+
+namespace asio_ipfs {
+
+// Returns the CID that `node::add` assigns to `data` with go-ipfs' default
+// import settings: 256 KiB fixed size chunks, balanced DAG layout, UnixFS
+// leaves wrapped in dag-pb, sha2-256 and CIDv0. Runs entirely in C++ and
+// doesn't need a running node.
+std::string calculate_cid(boost::string_view data);
+
+} // namespace
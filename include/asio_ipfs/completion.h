@@ -0,0 +1,220 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <boost/version.hpp>
+#include <boost/system/error_code.hpp>
+
+#if BOOST_VERSION >= 107000
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#endif
+
+#if BOOST_VERSION >= 107700
+#include <boost/asio/associated_cancellation_slot.hpp>
+#include <boost/asio/cancellation_type.hpp>
+#endif
+
+namespace asio_ipfs { namespace detail {
+
+/*
+ * A pending operation's completion, as the compiled part of the library
+ * sees it. Exactly one of `complete` and `destroy` gets called, after which
+ * the object is gone.
+ */
+template<class... Ret>
+class op {
+public:
+    virtual void complete(boost::system::error_code, Ret...) = 0;
+
+    // Drops the operation without completing it.
+    virtual void destroy() = 0;
+
+protected:
+    ~op() {}
+};
+
+/*
+ * Owns an `op`, and completes it when called. It can be moved but not
+ * copied, and called only once. Destroying it uncalled destroys the op.
+ */
+template<class... Ret>
+class callback {
+public:
+    callback() = default;
+
+    explicit callback(op<Ret...>* o) : _op(o) {}
+
+    callback(callback&& other) noexcept : _op(other._op) {
+        other._op = nullptr;
+    }
+
+    callback& operator=(callback&& other) noexcept {
+        if (this != &other) {
+            if (_op) _op->destroy();
+            _op = other._op;
+            other._op = nullptr;
+        }
+        return *this;
+    }
+
+    ~callback() {
+        if (_op) _op->destroy();
+    }
+
+    explicit operator bool() const { return _op != nullptr; }
+
+    void operator()(boost::system::error_code ec, Ret... ret) {
+        auto o = _op;
+        _op = nullptr;
+        o->complete(ec, std::move(ret)...);
+    }
+
+private:
+    op<Ret...>* _op = nullptr;
+};
+
+#if BOOST_VERSION >= 107000
+
+/*
+ * The `op` of a concrete completion handler, which may be move-only. It is
+ * allocated with the handler's associated allocator and calls the handler
+ * through its associated executor, the same way Asio's own operations do.
+ * Its memory is given back before the handler gets called, so a handler
+ * starting another operation can have it reused.
+ */
+template<class Handler, class... Ret>
+class handler_op final : public op<Ret...> {
+    using executor_type
+        = typename boost::asio::associated_executor<Handler>::type;
+
+    using allocator_type
+        = typename std::allocator_traits
+              < typename boost::asio::associated_allocator<Handler>::type
+              >::template rebind_alloc<handler_op>;
+
+    using alloc_traits = std::allocator_traits<allocator_type>;
+
+public:
+    static handler_op* create(Handler h) {
+        allocator_type a(boost::asio::get_associated_allocator(h));
+        handler_op* p = alloc_traits::allocate(a, 1);
+
+        try {
+            return new (p) handler_op(std::move(h));
+        }
+        catch (...) {
+            alloc_traits::deallocate(a, p, 1);
+            throw;
+        }
+    }
+
+    // Returns the cancel function to hand over to the operation. If the
+    // handler has a connected cancellation slot, emitting it invokes that
+    // function.
+    std::function<void()>* connect_cancel(std::function<void()>* cancel) {
+#if BOOST_VERSION >= 107700
+        auto slot = boost::asio::get_associated_cancellation_slot(_handler);
+
+        if (slot.is_connected()) {
+            if (!cancel) cancel = &_cancel;
+            slot.assign([cancel] (boost::asio::cancellation_type_t) {
+                    (*cancel)();
+                });
+        }
+#endif
+        return cancel;
+    }
+
+    void complete(boost::system::error_code ec, Ret... ret) override {
+#if BOOST_VERSION >= 107700
+        boost::asio::get_associated_cancellation_slot(_handler).clear();
+#endif
+
+        allocator_type a(boost::asio::get_associated_allocator(_handler));
+        Handler h(std::move(_handler));
+        // Only let go of the executor once the handler is queued on it,
+        // otherwise it may run out of work and stop in between.
+        auto work = std::move(_work);
+        free(a);
+
+        boost::asio::dispatch(work.get_executor(),
+            [h = std::move(h), args = std::make_tuple(ec, std::move(ret)...)]
+            () mutable {
+                call(h, std::move(args),
+                     std::index_sequence_for<boost::system::error_code, Ret...>());
+            });
+    }
+
+    void destroy() override {
+#if BOOST_VERSION >= 107700
+        boost::asio::get_associated_cancellation_slot(_handler).clear();
+#endif
+
+        allocator_type a(boost::asio::get_associated_allocator(_handler));
+        free(a);
+    }
+
+private:
+    explicit handler_op(Handler h)
+        : _handler(std::move(h))
+        , _work(boost::asio::get_associated_executor(_handler))
+    {}
+
+    void free(allocator_type& a) {
+        this->~handler_op();
+        alloc_traits::deallocate(a, this, 1);
+    }
+
+    template<class Args, size_t... I>
+    static void call(Handler& h, Args&& args, std::index_sequence<I...>) {
+        h(std::get<I>(std::move(args))...);
+    }
+
+private:
+    Handler _handler;
+    boost::asio::executor_work_guard<executor_type> _work;
+    // The operation's cancel function, if the caller didn't give one and
+    // cancels through the handler's cancellation slot instead.
+    std::function<void()> _cancel;
+};
+
+#else // BOOST_VERSION < 107000
+
+// Handlers of older Boost versions are called right where the operation
+// completes, which is in a thread running the node's io_service.
+template<class Handler, class... Ret>
+class handler_op final : public op<Ret...> {
+public:
+    static handler_op* create(Handler h) {
+        return new handler_op(std::move(h));
+    }
+
+    std::function<void()>* connect_cancel(std::function<void()>* cancel) {
+        return cancel;
+    }
+
+    void complete(boost::system::error_code ec, Ret... ret) override {
+        Handler h(std::move(_handler));
+        delete this;
+        h(ec, std::move(ret)...);
+    }
+
+    void destroy() override {
+        delete this;
+    }
+
+private:
+    explicit handler_op(Handler h) : _handler(std::move(h)) {}
+
+private:
+    Handler _handler;
+};
+
+#endif // BOOST_VERSION >= 107000
+
+}} // asio_ipfs::detail namespace
@@ -16,6 +16,7 @@ namespace asio_ipfs { namespace error {
         invalid_db_format,
         malformed_db_entry,
         missing_ipfs_link,
+        overloaded, // Too many operations queued by admission control
     };
     
     struct ipfs_category : public boost::system::error_category
@@ -46,6 +47,16 @@ namespace asio_ipfs { namespace error {
                     return "failed to pin";
                 case IPFS_UNPIN_FAILED:
                     return "failed to unpin";
+                case IPFS_GC_FAILED:
+                    return "failed to collect garbage";
+                case IPFS_CONNECT_FAILED:
+                    return "failed to connect to peer";
+                case IPFS_PREFETCH_FAILED:
+                    return "failed to prefetch";
+                case IPFS_BLOCK_FAILED:
+                    return "failed to get or put block";
+                case IPFS_BUFFER_TOO_SMALL:
+                    return "block doesn't fit the buffer";
                 default:
                     return "unknown ipfs error";
             }
@@ -70,6 +81,8 @@ namespace asio_ipfs { namespace error {
                     return "malformed database entry";
                 case error::missing_ipfs_link:
                     return "missing IPFS link to content";
+                case error::overloaded:
+                    return "too many operations queued";
                 default:
                     return "unknown asio_ipfs error";
             }
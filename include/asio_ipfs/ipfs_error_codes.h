@@ -14,5 +14,10 @@
 #define IPFS_PUBLISH_FAILED          6  // failed to publish CID
 #define IPFS_PIN_FAILED              7  // failed to publish CID
 #define IPFS_UNPIN_FAILED            8  // failed to publish CID
+#define IPFS_GC_FAILED               9  // failed to collect garbage
+#define IPFS_CONNECT_FAILED         10  // failed to connect to peer
+#define IPFS_PREFETCH_FAILED        11  // failed to fetch a DAG
+#define IPFS_BLOCK_FAILED           12  // failed to get or put a block
+#define IPFS_BUFFER_TOO_SMALL       13  // block doesn't fit the buffer
 
 #endif  // ndef GUARD_ipfs_error_codes_h
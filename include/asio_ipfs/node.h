@@ -1,20 +1,48 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstring>
 #include <string>
 #include <functional>
 #include <memory>
+#include <vector>
+#include <boost/asio/buffer.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/optional.hpp>
 #include <boost/utility/string_view.hpp>
+#include <boost/version.hpp>
+#include <asio_ipfs/completion.h>
 
 namespace asio_ipfs {
 
 struct node_impl;
 
+// Operations may be started from, and the `io_service` run in, any number of
+// threads. A `Cancel` object belongs to its operation's caller: the operation
+// sets it when it starts and doesn't touch it after that. It may then be
+// invoked from any thread, though not concurrently with itself, and does
+// nothing once the operation has completed.
+//
+// Arguments are copied, except for content: the data given to `add`,
+// `calculate_cid` and the `block_*` operations is only referred to and must
+// stay alive until the operation completes. With deferred completion tokens
+// (e.g. `use_awaitable`) that includes the time until it is awaited.
 class node {
     using Timer = boost::asio::steady_timer;
     using Cancel = std::function<void()>;
 
+#if BOOST_VERSION >= 107000
+    // What an operation started with `Token` returns.
+    template<class Token, class... Ret>
+    struct Result {
+        using type = typename boost::asio::async_result
+                        < typename std::decay<Token>::type
+                        , void(boost::system::error_code, Ret...)
+                        >::return_type;
+    };
+#else
     template<class Token, class... Ret>
     using Handler = typename boost::asio::handler_type
                         < Token
@@ -23,17 +51,278 @@ class node {
 
     template<class Token, class... Ret>
     using Result = typename boost::asio::async_result<Handler<Token, Ret...>>;
+#endif
+
+    // What the compiled part of the library completes an operation with.
+    template<class... Ret>
+    using Callback = detail::callback<Ret...>;
+
+    // Turns `token` into a completion handler and hands it over, wrapped in
+    // a Callback, to `start(Cancel*, Callback)` which starts the operation.
+    // The handler keeps its type, and the op holding it is the only thing
+    // allocated for it. With deferred tokens (e.g. `use_awaitable`) `start`
+    // only gets called once the operation is awaited, so it keeps copies of
+    // the arguments rather than references to them, content excepted.
+    template<class... Ret, class Token, class Start>
+    static typename Result<Token, Ret...>::type
+    initiate(Token&, Cancel*, Start&&);
 
     using string_view = boost::string_view;
 
+    // A CID or path an operation keeps a copy of. Those up to the length of
+    // a base32 CIDv1 stay inline, longer ones go to the heap.
+    class cid_copy {
+    public:
+        explicit cid_copy(string_view s) : _size(s.size()) {
+            if (_size <= sizeof(_inline)) std::memcpy(_inline, s.data(), _size);
+            else _heap.assign(s.data(), s.size());
+        }
+
+        operator string_view() const {
+            if (_size <= sizeof(_inline)) return string_view(_inline, _size);
+            return _heap;
+        }
+
+    private:
+        size_t _size;
+        char _inline[64];
+        std::string _heap;
+    };
+
 public:
+    // Length of a base58 CIDv0, the default. CIDs of other versions and
+    // hash functions differ in length, see `add_options`.
     static const uint32_t CID_SIZE = 46;
 
+    enum class datastore_type {
+        flatfs,  // Blocks in flatfs, everything else in leveldb
+        leveldb,
+        badger,
+        memory   // Nothing is persisted, the repository path is unused
+    };
+
+    enum class identity_type {
+        rsa,     // 2048 bits, takes a while to generate
+        ed25519
+    };
+
     struct config {
         bool         online       = true;
         unsigned int low_water    = 600;
         unsigned int high_water   = 900;
         unsigned int grace_period = 20; // seconds
+        // Let `add_file` reference file content in place instead of copying
+        // it into the repository (go-ipfs' filestore/nocopy mode). Only files
+        // under the parent directory of the repository qualify, others are
+        // added normally.
+        bool         filestore    = false;
+        // Only used when the repository gets created.
+        datastore_type datastore  = datastore_type::flatfs;
+        // Byte budget of the in-process cache of `cat` results, hits are
+        // served without going through IPFS. Only content named by a CID or
+        // an /ipfs/ path is cached, not that of /ipns/ paths. Zero disables
+        // the cache.
+        size_t       cat_cache_size = 0;
+        // `publish` calls made within this long of each other are collapsed
+        // into a single publish of the newest CID.
+        unsigned int publish_debounce = 100; // milliseconds
+        // Once the repository grows past this many bytes, garbage is
+        // collected automatically in small steps. Zero disables it.
+        uint64_t     gc_high_watermark = 0;
+        // Key type of the node's identity. Only used when the repository
+        // gets created.
+        identity_type identity    = identity_type::rsa;
+        // Connect to the bootstrap peers only once the first operation that
+        // may need the network (cat, resolve, publish, pin) starts, instead
+        // of while the node starts.
+        bool         lazy_bootstrap = false;
+        // Serve the HTTP API, including Prometheus metrics, on the address
+        // in the repository config. Only one node per process can listen on
+        // a given address, the metrics of all nodes carry their peer id.
+        bool         http_api     = true;
+        // Connect to the bootstrap peers in the repository config. Without
+        // them an online node only talks to peers found through local
+        // discovery or given to `connect`.
+        bool         bootstrap    = true;
+        // Admission control of the operations taking `call_options`: at most
+        // this many of each priority class run at once, and the rest wait in
+        // a queue of their class. Zero means no limit.
+        unsigned int max_interactive = 0;
+        unsigned int max_background  = 0;
+        // Operations finding the queue of their class this long fail with
+        // `error::overloaded` right away.
+        size_t       max_queued   = 1024;
+    };
+
+    // How content gets split into blocks and addressed. The defaults give
+    // the same CIDs as `calculate_cid`, except for files added to the
+    // filestore, whose leaves are raw.
+    struct add_options {
+        // "size-<bytes>" or "rabin-<min>-<avg>-<max>"
+        std::string chunker     = "size-262144";
+        // Store leaves as raw blocks instead of wrapping them in UnixFS.
+        // Unless set, leaves are raw with CIDv1 and when added to the
+        // filestore.
+        boost::optional<bool>     raw_leaves;
+        // Unless set, 0 with "sha2-256" and 1 with any other hash.
+        boost::optional<unsigned> cid_version;
+        // A multihash name, e.g. "sha2-256" or "blake2b-256".
+        std::string hash        = "sha2-256";
+    };
+
+    // How a raw block's CID is made: raw gives CIDv1 raw blocks, dag_pb
+    // CIDv0 and dag_cbor CIDv1, all with sha2-256.
+    enum class block_codec { raw, dag_pb, dag_cbor };
+
+    enum class priority_class {
+        automatic,   // `cat`s and `resolve`s are interactive, `pin`s background
+        interactive,
+        background
+    };
+
+    struct call_options {
+        // Fail with `asio::error::timed_out` unless done within this long,
+        // counting the time spent queued. Zero means no deadline.
+        Timer::duration timeout  = Timer::duration::zero();
+        priority_class  priority = priority_class::automatic;
+    };
+
+    class reader;
+    class writer;
+
+    // Completions of IPFS operations are delivered to the io_service in
+    // batches, `completions / wakeups` is the average batch size.
+    struct completion_stats {
+        uint64_t completions = 0;
+        uint64_t wakeups     = 0;
+    };
+
+    struct pin_progress {
+        uint64_t blocks = 0;    // Blocks fetched so far
+        uint64_t bytes  = 0;    // Bytes in those blocks
+        size_t cids_done  = 0;  // CIDs whose whole DAG has been fetched
+        size_t cids_total = 0;
+    };
+
+    struct pin_options {
+        // How many of the CIDs have their DAGs fetched concurrently.
+        unsigned parallelism = 8;
+        // Called periodically, and once more before completion, in the
+        // io_service.
+        std::function<void(const pin_progress&)> on_progress;
+    };
+
+    struct prefetch_options {
+        // How many blocks are requested from the network at once.
+        unsigned parallelism = 32;
+        // Pin the content recursively once all of it is local.
+        bool pin = false;
+    };
+
+    struct prefetch_result {
+        uint64_t blocks = 0; // Blocks in the DAG, fetched or already local
+        uint64_t bytes  = 0; // Bytes in those blocks
+    };
+
+    // Limits of a single `gc` step. Zero means no limit.
+    struct gc_budget {
+        Timer::duration time = std::chrono::milliseconds(50);
+        size_t blocks = 0;
+    };
+
+    struct gc_result {
+        uint64_t blocks_removed = 0;
+        uint64_t bytes_freed    = 0;
+        std::chrono::nanoseconds duration{0};
+        // Whether the garbage collection pass has completed. If not, further
+        // calls to `gc` continue where this one left off.
+        bool complete = false;
+    };
+
+    struct resolve_cache_stats {
+        uint64_t hits             = 0; // Fresh cached answers
+        uint64_t stale_hits       = 0; // Answered from cache while refreshing
+        uint64_t misses           = 0;
+        uint64_t refreshes        = 0; // Background refreshes done
+        uint64_t refresh_failures = 0;
+        std::chrono::nanoseconds refresh_time{0}; // Total time spent refreshing
+    };
+
+    struct cat_cache_stats {
+        uint64_t hits      = 0;
+        uint64_t misses    = 0;
+        uint64_t evictions = 0;
+        uint64_t entries   = 0;
+        uint64_t bytes     = 0;
+    };
+
+    // The operations `get_stats` reports on.
+    enum class op_type {
+        build, add, add_batch, add_file, write, finish, cat, cat_range, read,
+        resolve, publish, pin, unpin, pin_many, unpin_many, gc, connect,
+        prefetch, block_put, block_get
+    };
+
+    static const size_t op_type_count = 20;
+
+    static const char* op_type_name(op_type);
+
+    // Latencies at microsecond resolution in log-linear buckets, eight per
+    // power of two, so a percentile is off by at most 12.5%. Values of
+    // about 71 minutes and more all end up in the last bucket.
+    struct latency_histogram {
+        static const size_t bucket_count = 240;
+
+        std::array<uint64_t, bucket_count> buckets{};
+        uint64_t count = 0;
+        std::chrono::microseconds sum{0};
+
+        // The upper bound of the bucket the `p`th (0 to 1) latency falls in.
+        std::chrono::microseconds percentile(double p) const;
+        std::chrono::microseconds mean() const;
+
+        static size_t bucket_index(std::chrono::microseconds);
+        // Bucket `i` holds latencies in [lower_bound(i), lower_bound(i + 1)).
+        static std::chrono::microseconds lower_bound(size_t i);
+    };
+
+    struct op_stats {
+        uint64_t started   = 0;
+        uint64_t succeeded = 0;
+        uint64_t failed    = 0;
+        uint64_t aborted   = 0; // Cancelled, or the node got destroyed
+        uint64_t in_flight = 0;
+        uint64_t bytes_in  = 0; // Content received from IPFS
+        uint64_t bytes_out = 0; // Content handed over to IPFS
+        // From the start of an operation until its handler gets called.
+        latency_histogram latency;
+    };
+
+    struct admission_stats {
+        struct queue {
+            unsigned int limit = 0; // Zero if unlimited
+            uint64_t running   = 0;
+            uint64_t queued    = 0;
+            uint64_t admitted  = 0; // Started, right away or after waiting
+            uint64_t rejected  = 0; // Failed with `error::overloaded`
+            uint64_t expired   = 0; // Timed out while queued
+            // Time from the call until the operation started.
+            latency_histogram wait;
+        };
+
+        queue interactive;
+        queue background;
+    };
+
+    struct stats {
+        std::array<op_stats, op_type_count> ops;
+        // From Go being done with an operation until its handler gets
+        // called, i.e. time spent waiting for the io_service.
+        latency_histogram completion_delay;
+
+        const op_stats& operator[](op_type t) const {
+            return ops[static_cast<size_t>(t)];
+        }
     };
 
 public:
@@ -61,6 +350,21 @@ public:
     // Returns this node's IPFS ID
     std::string id() const;
 
+    // The addresses this node's swarm listens on, each ending in
+    // "/ipfs/<id>" so it can be passed to another node's `connect`. Empty
+    // if the node is offline.
+    std::vector<std::string> swarm_addresses() const;
+
+    // Connects to the peer at `address`, a multiaddress ending in
+    // "/ipfs/<id>".
+    template<class Token>
+    typename Result<Token>::type
+    connect(const std::string& address, Token&&);
+
+    template<class Token>
+    typename Result<Token>::type
+    connect(const std::string& address, Cancel&, Token&&);
+
     template<class Token>
     typename Result<Token, std::string>::type
     add(const uint8_t* data, size_t size, Token&&);
@@ -79,8 +383,134 @@ public:
 
     template<class Token>
     typename Result<Token, std::string>::type
-    calculate_cid(const string_view, Cancel&, Token&&);
+    add(const uint8_t* data, size_t size, const add_options&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    add(const uint8_t* data, size_t size, const add_options&, Cancel&, Token&&);
 
+    template<class Token>
+    typename Result<Token, std::string>::type
+    add(const std::string&, const add_options&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    add(const std::string&, const add_options&, Cancel&, Token&&);
+
+    // Adds every buffer as a separate piece of content and returns their
+    // CIDs in the same order. The whole batch crosses into IPFS at once and
+    // completes at once, which makes it much cheaper than individual `add`s
+    // for many small items. If any of the adds fails, the batch fails.
+    template<class Token>
+    typename Result<Token, std::vector<std::string>>::type
+    add_batch(const std::vector<boost::asio::const_buffer>&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::vector<std::string>>::type
+    add_batch(const std::vector<boost::asio::const_buffer>&, Cancel&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::vector<std::string>>::type
+    add_batch( const std::vector<boost::asio::const_buffer>&
+             , const add_options&
+             , Token&&);
+
+    template<class Token>
+    typename Result<Token, std::vector<std::string>>::type
+    add_batch( const std::vector<boost::asio::const_buffer>&
+             , const add_options&
+             , Cancel&
+             , Token&&);
+
+    // Stores `data` as a single block, as is, and returns its CID. Unlike
+    // `add` no UnixFS wrapping or chunking is done, so blocks should be kept
+    // within IPFS' 1MiB limit for them to be exchanged with other nodes.
+    // Blocks aren't pinned, `pin` them to keep them from being collected.
+    template<class Token>
+    typename Result<Token, std::string>::type
+    block_put(boost::asio::const_buffer data, block_codec, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    block_put(boost::asio::const_buffer data, block_codec, Cancel&, Token&&);
+
+    // Stores every buffer as a block, in one batch, and returns their CIDs in
+    // the same order.
+    template<class Token>
+    typename Result<Token, std::vector<std::string>>::type
+    block_put_many( const std::vector<boost::asio::const_buffer>&
+                  , block_codec
+                  , Token&&);
+
+    template<class Token>
+    typename Result<Token, std::vector<std::string>>::type
+    block_put_many( const std::vector<boost::asio::const_buffer>&
+                  , block_codec
+                  , Cancel&
+                  , Token&&);
+
+    // Copies the block `cid` straight into `buffer` and returns its size.
+    // Fails with IPFS_BUFFER_TOO_SMALL, writing nothing, if it doesn't fit.
+    // The buffer is not written to once the handler got called, even if the
+    // operation got cancelled.
+    template<class Token>
+    typename Result<Token, size_t>::type
+    block_get(const std::string& cid, boost::asio::mutable_buffer, Token&&);
+
+    template<class Token>
+    typename Result<Token, size_t>::type
+    block_get( const std::string& cid, boost::asio::mutable_buffer
+             , Cancel&, Token&&);
+
+    // Gets the blocks `cids[i]` into `buffers[i]`, all of them as one
+    // request to the block service, and returns their sizes. If any of them
+    // fails or doesn't fit, none of the buffers are written to.
+    template<class Token>
+    typename Result<Token, std::vector<size_t>>::type
+    block_get_many( const std::vector<std::string>& cids
+                  , const std::vector<boost::asio::mutable_buffer>&
+                  , Token&&);
+
+    template<class Token>
+    typename Result<Token, std::vector<size_t>>::type
+    block_get_many( const std::vector<std::string>& cids
+                  , const std::vector<boost::asio::mutable_buffer>&
+                  , Cancel&
+                  , Token&&);
+
+    // Adds the content of the file at `path` without loading it into memory.
+    template<class Token>
+    typename Result<Token, std::string>::type
+    add_file(const std::string& path, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    add_file(const std::string& path, Cancel&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    add_file(const std::string& path, const add_options&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    add_file(const std::string& path, const add_options&, Cancel&, Token&&);
+
+    // Starts an incremental `add`. Push the content with
+    // `writer::async_write` and get the CID with `writer::async_finish`.
+    // The writer must not outlive this node.
+    writer add_stream();
+    writer add_stream(const add_options&);
+
+    // The CID `add` with default options would give `data`, calculated
+    // without going through IPFS. Inputs over 1MiB are hashed on a thread of
+    // their own rather than in the io_service.
+    template<class Token>
+    typename Result<Token, std::string>::type
+    calculate_cid(const string_view data, Cancel&, Token&&);
+
+    // Concurrent `cat`s of the same CID (and likewise concurrent `resolve`s
+    // of the same name) share a single IPFS operation. Cancelling one of
+    // them only cancels that operation once all of them are cancelled.
     template<class Token>
     typename Result<Token, std::string>::type
     cat(string_view cid, Token&&);
@@ -89,14 +519,60 @@ public:
     typename Result<Token, std::string>::type
     cat(string_view cid, Cancel&, Token&&);
 
+    // Operations taking `call_options` can be given a deadline, and are
+    // subject to admission control (see `config::max_interactive`).
+    template<class Token>
+    typename Result<Token, std::string>::type
+    cat(string_view cid, const call_options&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    cat(string_view cid, const call_options&, Cancel&, Token&&);
+
+    // Returns at most `length` bytes of the content starting at `offset`.
+    // Only the blocks covering that range are fetched. Reading past the end
+    // of the content yields fewer bytes, possibly none.
+    template<class Token>
+    typename Result<Token, std::string>::type
+    cat(string_view cid, uint64_t offset, uint64_t length, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    cat(string_view cid, uint64_t offset, uint64_t length, Cancel&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    cat( string_view cid, uint64_t offset, uint64_t length
+       , const call_options&, Cancel&, Token&&);
+
+    // Returns a stream over the content of `cid`. Nothing is fetched until
+    // the first `async_read_some` on the returned reader. The reader must
+    // not outlive this node.
+    reader cat_stream(string_view cid);
+
+    // Same as above, but the stream covers only the `length` bytes of the
+    // content starting at `offset`.
+    reader cat_stream(string_view cid, uint64_t offset, uint64_t length);
+
+    // Publishes `cid` under this node's id, valid for the given duration,
+    // which must be at least a second (`asio::error::invalid_argument`
+    // otherwise). Calls close together are collapsed into one publish of
+    // the newest CID, which completes all of them. Unless valid for less
+    // than 20 seconds, the newest CID is then republished automatically
+    // whenever half of its validity has passed, until `stop_republishing`.
     template<class Token>
-    void
+    typename Result<Token>::type
     publish(const std::string& cid, Timer::duration, Token&&);
 
     template<class Token>
-    void
+    typename Result<Token>::type
     publish(const std::string& cid, Timer::duration, Cancel&, Token&&);
 
+    // Stops republishing the last published CID, it stays resolvable until
+    // its record expires. Ordered with respect to `publish` calls: one made
+    // after this gets republished again.
+    void stop_republishing();
+
     template<class Token>
     typename Result<Token, std::string>::type
     resolve(const std::string& node_id, Token&&);
@@ -105,22 +581,121 @@ public:
     typename Result<Token, std::string>::type
     resolve(const std::string& node_id, Cancel&, Token&&);
 
+    // Resolved names are cached for as long as their IPNS record says, the
+    // 4096 most recently used of them. Past the record's TTL, but before it
+    // expires, the cached value is still returned while it gets refreshed in
+    // the background. With `fresh` set the cache is bypassed (but updated).
+    template<class Token>
+    typename Result<Token, std::string>::type
+    resolve(const std::string& node_id, bool fresh, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    resolve(const std::string& node_id, bool fresh, Cancel&, Token&&);
+
     template<class Token>
-    void
+    typename Result<Token, std::string>::type
+    resolve(const std::string& node_id, bool fresh, const call_options&, Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    resolve( const std::string& node_id, bool fresh
+           , const call_options&, Cancel&, Token&&);
+
+    template<class Token>
+    typename Result<Token>::type
     pin(const std::string& cid, Token&&);
 
     template<class Token>
-    void
+    typename Result<Token>::type
     pin(const std::string& cid, Cancel&, Token&&);
 
     template<class Token>
-    void
+    typename Result<Token>::type
+    pin(const std::string& cid, const call_options&, Token&&);
+
+    template<class Token>
+    typename Result<Token>::type
+    pin(const std::string& cid, const call_options&, Cancel&, Token&&);
+
+    template<class Token>
+    typename Result<Token>::type
     unpin(const std::string& cid, Token&&);
 
     template<class Token>
-    void
+    typename Result<Token>::type
     unpin(const std::string& cid, Cancel&, Token&&);
 
+    // Fetches the DAGs of all the CIDs and then pins them all at once. On
+    // failure none of them are pinned.
+    template<class Token>
+    typename Result<Token>::type
+    pin_many(const std::vector<std::string>& cids, Token&&);
+
+    template<class Token>
+    typename Result<Token>::type
+    pin_many(const std::vector<std::string>& cids, pin_options, Token&&);
+
+    template<class Token>
+    typename Result<Token>::type
+    pin_many(const std::vector<std::string>& cids, pin_options, Cancel&, Token&&);
+
+    template<class Token>
+    typename Result<Token>::type
+    pin_many( const std::vector<std::string>& cids, pin_options
+            , const call_options&, Cancel&, Token&&);
+
+    // Fetches the whole DAG under `cid` into the local blockstore without
+    // handing any of its content over, e.g. to warm up a node which is going
+    // to serve it.
+    template<class Token>
+    typename Result<Token, prefetch_result>::type
+    prefetch(const std::string& cid, prefetch_options, Token&&);
+
+    template<class Token>
+    typename Result<Token, prefetch_result>::type
+    prefetch(const std::string& cid, prefetch_options, Cancel&, Token&&);
+
+    template<class Token>
+    typename Result<Token, prefetch_result>::type
+    prefetch( const std::string& cid, prefetch_options
+            , const call_options&, Cancel&, Token&&);
+
+    // Unpins all of the CIDs at once. On failure none of them are unpinned.
+    template<class Token>
+    typename Result<Token>::type
+    unpin_many(const std::vector<std::string>& cids, Token&&);
+
+    template<class Token>
+    typename Result<Token>::type
+    unpin_many(const std::vector<std::string>& cids, Cancel&, Token&&);
+
+    // Removes unpinned blocks, within the given budget. Blocks are removed a
+    // few at a time, so concurrent `add`s and `pin`s are only held up
+    // briefly. Finding the unpinned blocks at the start of a pass however
+    // is not bounded by the budget.
+    template<class Token>
+    typename Result<Token, gc_result>::type
+    gc(gc_budget, Token&&);
+
+    template<class Token>
+    typename Result<Token, gc_result>::type
+    gc(gc_budget, Cancel&, Token&&);
+
+    completion_stats get_completion_stats() const;
+
+    // All zero if the cache is disabled.
+    cat_cache_stats get_cat_cache_stats() const;
+
+    resolve_cache_stats get_resolve_cache_stats() const;
+
+    admission_stats get_admission_stats() const;
+
+    // Counts operations that reach IPFS: `cat`s answered from the cache or
+    // joining an identical one in flight (and likewise for `resolve`) are
+    // not included. Recording is cheap enough to be always on.
+    stats get_stats() const;
+
     boost::asio::io_service& get_io_service();
 
     ~node();
@@ -134,42 +709,173 @@ private:
                , const std::string& repo_path
                , config
                , Cancel* cancel
-               , std::function<void( const boost::system::error_code&
-                                   , std::unique_ptr<node>)>);
+               , Callback<std::unique_ptr<node>>);
 
     void add_( const uint8_t* data, size_t size
+             , const add_options&
              , Cancel*
-             , std::function<void(boost::system::error_code, std::string)>);
+             , Callback<std::string>);
+
+    void add_batch_( const std::vector<boost::asio::const_buffer>&
+                   , const add_options&
+                   , Cancel*
+                   , Callback<std::vector<std::string>>);
+
+    void add_file_( const std::string& path
+                  , const add_options&
+                  , Cancel*
+                  , Callback<std::string>);
+
+    void block_put_( boost::asio::const_buffer
+                   , block_codec
+                   , Cancel*
+                   , Callback<std::string>);
+
+    void block_put_many_( const std::vector<boost::asio::const_buffer>&
+                        , block_codec
+                        , Cancel*
+                        , Callback<std::vector<std::string>>);
+
+    void block_get_( const std::string& cid
+                   , boost::asio::mutable_buffer
+                   , Cancel*
+                   , Callback<size_t>);
+
+    void block_get_many_( const std::vector<std::string>& cids
+                        , const std::vector<boost::asio::mutable_buffer>&
+                        , Cancel*
+                        , Callback<std::vector<size_t>>);
 
     void calculate_cid_( const string_view
                        , Cancel*
-                       , std::function<void(boost::system::error_code, std::string)>);
+                       , Callback<std::string>);
 
     void cat_( string_view cid
+             , const call_options&
              , Cancel*
-             , std::function<void(boost::system::error_code, std::string)>);
+             , Callback<std::string>);
+
+    void cat_range_( string_view cid
+                   , uint64_t offset
+                   , uint64_t length
+                   , const call_options&
+                   , Cancel*
+                   , Callback<std::string>);
 
     void publish_( const std::string& cid
                  , Timer::duration
                  , Cancel*
-                 , std::function<void(boost::system::error_code)>);
+                 , Callback<>);
 
     void resolve_( const std::string& ipns_id
+                 , bool fresh
+                 , const call_options&
                  , Cancel*
-                 , std::function<void(boost::system::error_code, std::string)>);
+                 , Callback<std::string>);
+
+    void connect_( const std::string& address
+                 , Cancel*
+                 , Callback<>);
 
     void pin_( const std::string& cid
+             , const call_options&
              , Cancel*
-             , std::function<void(boost::system::error_code)>);
+             , Callback<>);
 
     void unpin_( const std::string& cid
                , Cancel*
-               , std::function<void(boost::system::error_code)>);
+               , Callback<>);
+
+    void pin_many_( const std::vector<std::string>& cids
+                  , pin_options
+                  , const call_options&
+                  , Cancel*
+                  , Callback<>);
+
+    void prefetch_( const std::string& cid
+                  , prefetch_options
+                  , const call_options&
+                  , Cancel*
+                  , Callback<prefetch_result>);
+
+    void unpin_many_( const std::vector<std::string>& cids
+                    , Cancel*
+                    , Callback<>);
+
+    void gc_( gc_budget
+            , Cancel*
+            , Callback<gc_result>);
 
 private:
     std::unique_ptr<node_impl> _impl;
 };
 
+// Streaming access to the content of a single CID, see `node::cat_stream`.
+// Data is pulled from IPFS in bounded chunks only as the user asks for it,
+// so at most one read may be outstanding at any time. A successful read of
+// zero bytes is reported as `boost::asio::error::eof`. Cancelling a read
+// aborts the whole stream.
+class node::reader {
+public:
+    reader(reader&&);
+    reader& operator=(reader&&);
+
+    reader(const reader&) = delete;
+    reader& operator=(const reader&) = delete;
+
+    template<class MutableBufferSequence, class Token>
+    typename Result<Token, size_t>::type
+    async_read_some(const MutableBufferSequence&, Token&&);
+
+    template<class MutableBufferSequence, class Token>
+    typename Result<Token, size_t>::type
+    async_read_some(const MutableBufferSequence&, Cancel&, Token&&);
+
+    boost::asio::io_service& get_io_service();
+
+    ~reader();
+
+private:
+    friend class node;
+
+    reader(node_impl*, uint64_t id);
+
+    void read_some_( std::vector<boost::asio::mutable_buffer>
+                   , Cancel*
+                   , Callback<size_t>);
+
+    template<class MutableBufferSequence, class Token>
+    typename Result<Token, size_t>::type
+    async_read_some_(const MutableBufferSequence&, Cancel*, Token&&);
+
+private:
+    node_impl* _impl;
+    uint64_t _id;
+};
+
+template<class... Ret, class Token, class Start>
+inline
+typename node::Result<Token, Ret...>::type
+node::initiate(Token& token, Cancel* cancel, Start&& start)
+{
+#if BOOST_VERSION >= 107000
+    return boost::asio::async_initiate<Token, void(boost::system::error_code, Ret...)>(
+        [cancel] (auto handler, typename std::decay<Start>::type start) {
+            using Op = detail::handler_op<decltype(handler), Ret...>;
+            Op* op = Op::create(std::move(handler));
+            auto cancel_ = op->connect_cancel(cancel);
+            start(cancel_, Callback<Ret...>(op));
+        },
+        token, std::forward<Start>(start));
+#else
+    using Op = detail::handler_op<Handler<Token, Ret...>, Ret...>;
+    Handler<Token, Ret...> handler(token);
+    Result<Token, Ret...> result(handler);
+    start(cancel, Callback<Ret...>(Op::create(std::move(handler))));
+    return result.get();
+#endif
+}
+
 template<class Token>
 inline
 typename node::Result<Token, std::unique_ptr<node>>::type
@@ -179,10 +885,10 @@ node::build( boost::asio::io_service& ios
            , Token&& token)
 {
     using BackendP = std::unique_ptr<node>;
-    Handler<Token, BackendP> handler(std::forward<Token>(token));
-    Result<Token, BackendP> result(handler);
-    build_(ios, repo_path, cfg, nullptr, std::move(handler));
-    return result.get();
+    return initiate<BackendP>(token, nullptr,
+        [&ios, repo_path, cfg] (Cancel* cancel, Callback<BackendP> h) {
+            build_(ios, repo_path, cfg, cancel, std::move(h));
+        });
 }
 
 template<class Token>
@@ -195,10 +901,10 @@ node::build( boost::asio::io_service& ios
            , Token&& token)
 {
     using BackendP = std::unique_ptr<node>;
-    Handler<Token, BackendP> handler(std::forward<Token>(token));
-    Result<Token, BackendP> result(handler);
-    build_(ios, repo_path, cfg, &cancel, std::move(handler));
-    return result.get();
+    return initiate<BackendP>(token, &cancel,
+        [&ios, repo_path, cfg] (Cancel* cancel, Callback<BackendP> h) {
+            build_(ios, repo_path, cfg, cancel, std::move(h));
+        });
 }
 
 template<class Token>
@@ -206,10 +912,10 @@ inline
 typename node::Result<Token, std::string>::type
 node::add(const uint8_t* data, size_t size, Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    add_(data, size, nullptr, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, nullptr,
+        [this, data, size] (Cancel* cancel, Callback<std::string> h) {
+            add_(data, size, add_options(), cancel, std::move(h));
+        });
 }
 
 template<class Token>
@@ -217,10 +923,10 @@ inline
 typename node::Result<Token, std::string>::type
 node::add(const uint8_t* data, size_t size, Cancel& cancel, Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    add_(data, size, &cancel, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, &cancel,
+        [this, data, size] (Cancel* cancel, Callback<std::string> h) {
+            add_(data, size, add_options(), cancel, std::move(h));
+        });
 }
 
 template<class Token>
@@ -228,13 +934,14 @@ inline
 typename node::Result<Token, std::string>::type
 node::add(const std::string& data, Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    add_( reinterpret_cast<const uint8_t*>(data.c_str())
-        , data.size()
-        , nullptr
-        , std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, nullptr,
+        [this, &data] (Cancel* cancel, Callback<std::string> h) {
+            add_( reinterpret_cast<const uint8_t*>(data.c_str())
+                , data.size()
+                , add_options()
+                , cancel
+                , std::move(h));
+        });
 }
 
 template<class Token>
@@ -242,134 +949,881 @@ inline
 typename node::Result<Token, std::string>::type
 node::add(const std::string& data, Cancel& cancel, Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    add_( reinterpret_cast<const uint8_t*>(data.c_str())
-        , data.size()
-        , &cancel
-        , std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, &cancel,
+        [this, &data] (Cancel* cancel, Callback<std::string> h) {
+            add_( reinterpret_cast<const uint8_t*>(data.c_str())
+                , data.size()
+                , add_options()
+                , cancel
+                , std::move(h));
+        });
 }
 
 template<class Token>
 inline
 typename node::Result<Token, std::string>::type
-node::calculate_cid(const string_view data, Cancel& cancel, Token&& token)
+node::add( const uint8_t* data, size_t size
+         , const add_options& options
+         , Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    calculate_cid_(data, &cancel, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, nullptr,
+        [this, data, size, options] (Cancel* cancel, Callback<std::string> h) {
+            add_(data, size, options, cancel, std::move(h));
+        });
 }
 
 template<class Token>
 inline
 typename node::Result<Token, std::string>::type
-node::cat(string_view cid, Token&& token)
+node::add( const uint8_t* data, size_t size
+         , const add_options& options
+         , Cancel& cancel
+         , Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    cat_(cid, nullptr, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, &cancel,
+        [this, data, size, options] (Cancel* cancel, Callback<std::string> h) {
+            add_(data, size, options, cancel, std::move(h));
+        });
 }
 
 template<class Token>
 inline
 typename node::Result<Token, std::string>::type
-node::cat(string_view cid, Cancel& cancel, Token&& token)
+node::add( const std::string& data
+         , const add_options& options
+         , Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    cat_(cid, &cancel, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, nullptr,
+        [this, &data, options] (Cancel* cancel, Callback<std::string> h) {
+            add_( reinterpret_cast<const uint8_t*>(data.c_str())
+                , data.size()
+                , options
+                , cancel
+                , std::move(h));
+        });
 }
 
 template<class Token>
 inline
-void
-node::publish(const std::string& cid, Timer::duration d, Token&& token)
+typename node::Result<Token, std::string>::type
+node::add( const std::string& data
+         , const add_options& options
+         , Cancel& cancel
+         , Token&& token)
 {
-    Handler<Token> handler(std::forward<Token>(token));
-    Result<Token> result(handler);
-    publish_(cid, d, nullptr, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, &cancel,
+        [this, &data, options] (Cancel* cancel, Callback<std::string> h) {
+            add_( reinterpret_cast<const uint8_t*>(data.c_str())
+                , data.size()
+                , options
+                , cancel
+                , std::move(h));
+        });
 }
 
 template<class Token>
 inline
-void
-node::publish(const std::string& cid, Timer::duration d, Cancel& cancel, Token&& token)
+typename node::Result<Token, std::vector<std::string>>::type
+node::add_batch( const std::vector<boost::asio::const_buffer>& buffers
+               , Token&& token)
 {
-    Handler<Token> handler(std::forward<Token>(token));
-    Result<Token> result(handler);
-    publish_(cid, d, &cancel, std::move(handler));
-    return result.get();
+    using Cids = std::vector<std::string>;
+    return initiate<Cids>(token, nullptr,
+        [this, buffers] (Cancel* cancel, Callback<Cids> h) {
+            add_batch_(buffers, add_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::vector<std::string>>::type
+node::add_batch( const std::vector<boost::asio::const_buffer>& buffers
+               , Cancel& cancel
+               , Token&& token)
+{
+    using Cids = std::vector<std::string>;
+    return initiate<Cids>(token, &cancel,
+        [this, buffers] (Cancel* cancel, Callback<Cids> h) {
+            add_batch_(buffers, add_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::vector<std::string>>::type
+node::add_batch( const std::vector<boost::asio::const_buffer>& buffers
+               , const add_options& options
+               , Token&& token)
+{
+    using Cids = std::vector<std::string>;
+    return initiate<Cids>(token, nullptr,
+        [this, buffers, options] (Cancel* cancel, Callback<Cids> h) {
+            add_batch_(buffers, options, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::vector<std::string>>::type
+node::add_batch( const std::vector<boost::asio::const_buffer>& buffers
+               , const add_options& options
+               , Cancel& cancel
+               , Token&& token)
+{
+    using Cids = std::vector<std::string>;
+    return initiate<Cids>(token, &cancel,
+        [this, buffers, options] (Cancel* cancel, Callback<Cids> h) {
+            add_batch_(buffers, options, cancel, std::move(h));
+        });
 }
 
 template<class Token>
 inline
 typename node::Result<Token, std::string>::type
-node::resolve(const std::string& ipns_id, Token&& token)
+node::add_file(const std::string& path, Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    resolve_(ipns_id, nullptr, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, nullptr,
+        [this, path] (Cancel* cancel, Callback<std::string> h) {
+            add_file_(path, add_options(), cancel, std::move(h));
+        });
 }
 
 template<class Token>
 inline
 typename node::Result<Token, std::string>::type
-node::resolve(const std::string& ipns_id, Cancel& cancel, Token&& token)
+node::add_file(const std::string& path, Cancel& cancel, Token&& token)
 {
-    Handler<Token, std::string> handler(std::forward<Token>(token));
-    Result<Token, std::string> result(handler);
-    resolve_(ipns_id, &cancel, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, &cancel,
+        [this, path] (Cancel* cancel, Callback<std::string> h) {
+            add_file_(path, add_options(), cancel, std::move(h));
+        });
 }
 
 template<class Token>
 inline
-void
-node::pin(const std::string& cid, Token&& token)
+typename node::Result<Token, std::string>::type
+node::add_file( const std::string& path
+              , const add_options& options
+              , Token&& token)
 {
-    Handler<Token> handler(std::forward<Token>(token));
-    Result<Token> result(handler);
-    pin_(cid, nullptr, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, nullptr,
+        [this, path, options] (Cancel* cancel, Callback<std::string> h) {
+            add_file_(path, options, cancel, std::move(h));
+        });
 }
 
 template<class Token>
 inline
-void
-node::pin(const std::string& cid, Cancel& cancel, Token&& token)
+typename node::Result<Token, std::string>::type
+node::add_file( const std::string& path
+              , const add_options& options
+              , Cancel& cancel
+              , Token&& token)
 {
-    Handler<Token> handler(std::forward<Token>(token));
-    Result<Token> result(handler);
-    pin_(cid, &cancel, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, &cancel,
+        [this, path, options] (Cancel* cancel, Callback<std::string> h) {
+            add_file_(path, options, cancel, std::move(h));
+        });
 }
 
 template<class Token>
 inline
-void
-node::unpin(const std::string& cid, Token&& token)
+typename node::Result<Token, std::string>::type
+node::block_put( boost::asio::const_buffer data
+               , block_codec codec
+               , Token&& token)
 {
-    Handler<Token> handler(std::forward<Token>(token));
-    Result<Token> result(handler);
-    unpin_(cid, nullptr, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, nullptr,
+        [this, data, codec] (Cancel* cancel, Callback<std::string> h) {
+            block_put_(data, codec, cancel, std::move(h));
+        });
 }
 
 template<class Token>
 inline
-void
-node::unpin(const std::string& cid, Cancel& cancel, Token&& token)
+typename node::Result<Token, std::string>::type
+node::block_put( boost::asio::const_buffer data
+               , block_codec codec
+               , Cancel& cancel
+               , Token&& token)
 {
-    Handler<Token> handler(std::forward<Token>(token));
-    Result<Token> result(handler);
-    unpin_(cid, &cancel, std::move(handler));
-    return result.get();
+    return initiate<std::string>(token, &cancel,
+        [this, data, codec] (Cancel* cancel, Callback<std::string> h) {
+            block_put_(data, codec, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::vector<std::string>>::type
+node::block_put_many( const std::vector<boost::asio::const_buffer>& buffers
+                    , block_codec codec
+                    , Token&& token)
+{
+    return initiate<std::vector<std::string>>(token, nullptr,
+        [this, buffers, codec] (Cancel* cancel, Callback<std::vector<std::string>> h) {
+            block_put_many_(buffers, codec, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::vector<std::string>>::type
+node::block_put_many( const std::vector<boost::asio::const_buffer>& buffers
+                    , block_codec codec
+                    , Cancel& cancel
+                    , Token&& token)
+{
+    return initiate<std::vector<std::string>>(token, &cancel,
+        [this, buffers, codec] (Cancel* cancel, Callback<std::vector<std::string>> h) {
+            block_put_many_(buffers, codec, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, size_t>::type
+node::block_get( const std::string& cid
+               , boost::asio::mutable_buffer buffer
+               , Token&& token)
+{
+    return initiate<size_t>(token, nullptr,
+        [this, cid, buffer] (Cancel* cancel, Callback<size_t> h) {
+            block_get_(cid, buffer, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, size_t>::type
+node::block_get( const std::string& cid
+               , boost::asio::mutable_buffer buffer
+               , Cancel& cancel
+               , Token&& token)
+{
+    return initiate<size_t>(token, &cancel,
+        [this, cid, buffer] (Cancel* cancel, Callback<size_t> h) {
+            block_get_(cid, buffer, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::vector<size_t>>::type
+node::block_get_many( const std::vector<std::string>& cids
+                    , const std::vector<boost::asio::mutable_buffer>& buffers
+                    , Token&& token)
+{
+    return initiate<std::vector<size_t>>(token, nullptr,
+        [this, cids, buffers] (Cancel* cancel, Callback<std::vector<size_t>> h) {
+            block_get_many_(cids, buffers, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::vector<size_t>>::type
+node::block_get_many( const std::vector<std::string>& cids
+                    , const std::vector<boost::asio::mutable_buffer>& buffers
+                    , Cancel& cancel
+                    , Token&& token)
+{
+    return initiate<std::vector<size_t>>(token, &cancel,
+        [this, cids, buffers] (Cancel* cancel, Callback<std::vector<size_t>> h) {
+            block_get_many_(cids, buffers, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::calculate_cid(const string_view data, Cancel& cancel, Token&& token)
+{
+    return initiate<std::string>(token, &cancel,
+        [this, data] (Cancel* cancel, Callback<std::string> h) {
+            calculate_cid_(data, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::cat(string_view cid, Token&& token)
+{
+    return initiate<std::string>(token, nullptr,
+        [this, cid = cid_copy(cid)] (Cancel* cancel, Callback<std::string> h) {
+            cat_(cid, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::cat(string_view cid, Cancel& cancel, Token&& token)
+{
+    return initiate<std::string>(token, &cancel,
+        [this, cid = cid_copy(cid)] (Cancel* cancel, Callback<std::string> h) {
+            cat_(cid, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::cat(string_view cid, const call_options& options, Token&& token)
+{
+    return initiate<std::string>(token, nullptr,
+        [this, cid = cid_copy(cid), options] (Cancel* cancel, Callback<std::string> h) {
+            cat_(cid, options, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::cat( string_view cid
+         , const call_options& options
+         , Cancel& cancel
+         , Token&& token)
+{
+    return initiate<std::string>(token, &cancel,
+        [this, cid = cid_copy(cid), options] (Cancel* cancel, Callback<std::string> h) {
+            cat_(cid, options, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::cat(string_view cid, uint64_t offset, uint64_t length, Token&& token)
+{
+    return initiate<std::string>(token, nullptr,
+        [this, cid = cid_copy(cid), offset, length]
+        (Cancel* cancel, Callback<std::string> h) {
+            cat_range_( cid
+                      , offset
+                      , length
+                      , call_options()
+                      , cancel
+                      , std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::cat( string_view cid
+         , uint64_t offset
+         , uint64_t length
+         , Cancel& cancel
+         , Token&& token)
+{
+    return initiate<std::string>(token, &cancel,
+        [this, cid = cid_copy(cid), offset, length]
+        (Cancel* cancel, Callback<std::string> h) {
+            cat_range_( cid
+                      , offset
+                      , length
+                      , call_options()
+                      , cancel
+                      , std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::cat( string_view cid
+         , uint64_t offset
+         , uint64_t length
+         , const call_options& options
+         , Cancel& cancel
+         , Token&& token)
+{
+    return initiate<std::string>(token, &cancel,
+        [this, cid = cid_copy(cid), offset, length, options]
+        (Cancel* cancel, Callback<std::string> h) {
+            cat_range_(cid, offset, length, options, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::publish(const std::string& cid, Timer::duration d, Token&& token)
+{
+    return initiate(token, nullptr,
+        [this, cid, d] (Cancel* cancel, Callback<> h) {
+            publish_(cid, d, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::publish(const std::string& cid, Timer::duration d, Cancel& cancel, Token&& token)
+{
+    return initiate(token, &cancel,
+        [this, cid, d] (Cancel* cancel, Callback<> h) {
+            publish_(cid, d, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::resolve(const std::string& ipns_id, Token&& token)
+{
+    return initiate<std::string>(token, nullptr,
+        [this, ipns_id] (Cancel* cancel, Callback<std::string> h) {
+            resolve_(ipns_id, false, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::resolve(const std::string& ipns_id, Cancel& cancel, Token&& token)
+{
+    return initiate<std::string>(token, &cancel,
+        [this, ipns_id] (Cancel* cancel, Callback<std::string> h) {
+            resolve_(ipns_id, false, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::resolve(const std::string& ipns_id, bool fresh, Token&& token)
+{
+    return initiate<std::string>(token, nullptr,
+        [this, ipns_id, fresh] (Cancel* cancel, Callback<std::string> h) {
+            resolve_(ipns_id, fresh, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::resolve(const std::string& ipns_id, bool fresh, Cancel& cancel, Token&& token)
+{
+    return initiate<std::string>(token, &cancel,
+        [this, ipns_id, fresh] (Cancel* cancel, Callback<std::string> h) {
+            resolve_(ipns_id, fresh, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::resolve( const std::string& ipns_id
+             , bool fresh
+             , const call_options& options
+             , Token&& token)
+{
+    return initiate<std::string>(token, nullptr,
+        [this, ipns_id, fresh, options] (Cancel* cancel, Callback<std::string> h) {
+            resolve_(ipns_id, fresh, options, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::resolve( const std::string& ipns_id
+             , bool fresh
+             , const call_options& options
+             , Cancel& cancel
+             , Token&& token)
+{
+    return initiate<std::string>(token, &cancel,
+        [this, ipns_id, fresh, options] (Cancel* cancel, Callback<std::string> h) {
+            resolve_(ipns_id, fresh, options, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::connect(const std::string& address, Token&& token)
+{
+    return initiate(token, nullptr,
+        [this, address] (Cancel* cancel, Callback<> h) {
+            connect_(address, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::connect(const std::string& address, Cancel& cancel, Token&& token)
+{
+    return initiate(token, &cancel,
+        [this, address] (Cancel* cancel, Callback<> h) {
+            connect_(address, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::pin(const std::string& cid, Token&& token)
+{
+    return initiate(token, nullptr,
+        [this, cid] (Cancel* cancel, Callback<> h) {
+            pin_(cid, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::pin(const std::string& cid, Cancel& cancel, Token&& token)
+{
+    return initiate(token, &cancel,
+        [this, cid] (Cancel* cancel, Callback<> h) {
+            pin_(cid, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::pin(const std::string& cid, const call_options& options, Token&& token)
+{
+    return initiate(token, nullptr,
+        [this, cid, options] (Cancel* cancel, Callback<> h) {
+            pin_(cid, options, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::pin( const std::string& cid
+         , const call_options& options
+         , Cancel& cancel
+         , Token&& token)
+{
+    return initiate(token, &cancel,
+        [this, cid, options] (Cancel* cancel, Callback<> h) {
+            pin_(cid, options, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::unpin(const std::string& cid, Token&& token)
+{
+    return initiate(token, nullptr,
+        [this, cid] (Cancel* cancel, Callback<> h) {
+            unpin_(cid, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::unpin(const std::string& cid, Cancel& cancel, Token&& token)
+{
+    return initiate(token, &cancel,
+        [this, cid] (Cancel* cancel, Callback<> h) {
+            unpin_(cid, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::pin_many(const std::vector<std::string>& cids, Token&& token)
+{
+    return initiate(token, nullptr,
+        [this, cids] (Cancel* cancel, Callback<> h) {
+            pin_many_( cids
+                     , pin_options()
+                     , call_options()
+                     , cancel
+                     , std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::pin_many( const std::vector<std::string>& cids
+              , pin_options options
+              , Token&& token)
+{
+    return initiate(token, nullptr,
+        [this, cids, options] (Cancel* cancel, Callback<> h) mutable {
+            pin_many_( cids
+                     , std::move(options)
+                     , call_options()
+                     , cancel
+                     , std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::pin_many( const std::vector<std::string>& cids
+              , pin_options options
+              , Cancel& cancel
+              , Token&& token)
+{
+    return initiate(token, &cancel,
+        [this, cids, options] (Cancel* cancel, Callback<> h) mutable {
+            pin_many_( cids
+                     , std::move(options)
+                     , call_options()
+                     , cancel
+                     , std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::pin_many( const std::vector<std::string>& cids
+              , pin_options options
+              , const call_options& call
+              , Cancel& cancel
+              , Token&& token)
+{
+    return initiate(token, &cancel,
+        [this, cids, options, call] (Cancel* cancel, Callback<> h) mutable {
+            pin_many_(cids, std::move(options), call, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, node::prefetch_result>::type
+node::prefetch(const std::string& cid, prefetch_options options, Token&& token)
+{
+    return initiate<prefetch_result>(token, nullptr,
+        [this, cid, options] (Cancel* cancel, Callback<prefetch_result> h) {
+            prefetch_(cid, options, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, node::prefetch_result>::type
+node::prefetch( const std::string& cid
+              , prefetch_options options
+              , Cancel& cancel
+              , Token&& token)
+{
+    return initiate<prefetch_result>(token, &cancel,
+        [this, cid, options] (Cancel* cancel, Callback<prefetch_result> h) {
+            prefetch_(cid, options, call_options(), cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, node::prefetch_result>::type
+node::prefetch( const std::string& cid
+              , prefetch_options options
+              , const call_options& call
+              , Cancel& cancel
+              , Token&& token)
+{
+    return initiate<prefetch_result>(token, &cancel,
+        [this, cid, options, call] (Cancel* cancel, Callback<prefetch_result> h) {
+            prefetch_(cid, options, call, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::unpin_many(const std::vector<std::string>& cids, Token&& token)
+{
+    return initiate(token, nullptr,
+        [this, cids] (Cancel* cancel, Callback<> h) {
+            unpin_many_(cids, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token>::type
+node::unpin_many(const std::vector<std::string>& cids, Cancel& cancel, Token&& token)
+{
+    return initiate(token, &cancel,
+        [this, cids] (Cancel* cancel, Callback<> h) {
+            unpin_many_(cids, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, node::gc_result>::type
+node::gc(gc_budget budget, Token&& token)
+{
+    return initiate<gc_result>(token, nullptr,
+        [this, budget] (Cancel* cancel, Callback<gc_result> h) {
+            gc_(budget, cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, node::gc_result>::type
+node::gc(gc_budget budget, Cancel& cancel, Token&& token)
+{
+    return initiate<gc_result>(token, &cancel,
+        [this, budget] (Cancel* cancel, Callback<gc_result> h) {
+            gc_(budget, cancel, std::move(h));
+        });
+}
+
+// Incremental `add`, see `node::add_stream`. Each write completes once the
+// IPFS importer has consumed the data, so memory use is bounded by the
+// importer's chunker window rather than by the size of the content. At most
+// one operation may be outstanding at any time. Cancelling any operation
+// aborts the whole stream.
+class node::writer {
+public:
+    writer(writer&&);
+    writer& operator=(writer&&);
+
+    writer(const writer&) = delete;
+    writer& operator=(const writer&) = delete;
+
+    // Completes when all of the data has been written.
+    template<class ConstBufferSequence, class Token>
+    typename Result<Token, size_t>::type
+    async_write(const ConstBufferSequence&, Token&&);
+
+    template<class ConstBufferSequence, class Token>
+    typename Result<Token, size_t>::type
+    async_write(const ConstBufferSequence&, Cancel&, Token&&);
+
+    // Marks the end of the content and returns its CID.
+    template<class Token>
+    typename Result<Token, std::string>::type
+    async_finish(Token&&);
+
+    template<class Token>
+    typename Result<Token, std::string>::type
+    async_finish(Cancel&, Token&&);
+
+    boost::asio::io_service& get_io_service();
+
+    ~writer();
+
+private:
+    friend class node;
+
+    writer(node_impl*, uint64_t id);
+
+    void write_( std::vector<boost::asio::const_buffer>
+               , Cancel*
+               , Callback<size_t>);
+
+    void finish_( Cancel*
+                , Callback<std::string>);
+
+    template<class ConstBufferSequence, class Token>
+    typename Result<Token, size_t>::type
+    async_write_(const ConstBufferSequence&, Cancel*, Token&&);
+
+private:
+    node_impl* _impl;
+    uint64_t _id;
+};
+
+template<class MutableBufferSequence, class Token>
+inline
+typename node::Result<Token, size_t>::type
+node::reader::async_read_some_( const MutableBufferSequence& buffers
+                              , Cancel* cancel
+                              , Token&& token)
+{
+    return node::initiate<size_t>(token, cancel,
+        [this, buffers] (Cancel* cancel, Callback<size_t> h) {
+            read_some_( std::vector<boost::asio::mutable_buffer>(buffers.begin(), buffers.end())
+                      , cancel
+                      , std::move(h));
+        });
+}
+
+template<class MutableBufferSequence, class Token>
+inline
+typename node::Result<Token, size_t>::type
+node::reader::async_read_some(const MutableBufferSequence& buffers, Token&& token)
+{
+    return async_read_some_(buffers, nullptr, std::forward<Token>(token));
+}
+
+template<class MutableBufferSequence, class Token>
+inline
+typename node::Result<Token, size_t>::type
+node::reader::async_read_some( const MutableBufferSequence& buffers
+                             , Cancel& cancel
+                             , Token&& token)
+{
+    return async_read_some_(buffers, &cancel, std::forward<Token>(token));
+}
+
+template<class ConstBufferSequence, class Token>
+inline
+typename node::Result<Token, size_t>::type
+node::writer::async_write_( const ConstBufferSequence& buffers
+                          , Cancel* cancel
+                          , Token&& token)
+{
+    return node::initiate<size_t>(token, cancel,
+        [this, buffers] (Cancel* cancel, Callback<size_t> h) {
+            write_( std::vector<boost::asio::const_buffer>(buffers.begin(), buffers.end())
+                  , cancel
+                  , std::move(h));
+        });
+}
+
+template<class ConstBufferSequence, class Token>
+inline
+typename node::Result<Token, size_t>::type
+node::writer::async_write(const ConstBufferSequence& buffers, Token&& token)
+{
+    return async_write_(buffers, nullptr, std::forward<Token>(token));
+}
+
+template<class ConstBufferSequence, class Token>
+inline
+typename node::Result<Token, size_t>::type
+node::writer::async_write( const ConstBufferSequence& buffers
+                         , Cancel& cancel
+                         , Token&& token)
+{
+    return async_write_(buffers, &cancel, std::forward<Token>(token));
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::writer::async_finish(Token&& token)
+{
+    return node::initiate<std::string>(token, nullptr,
+        [this] (Cancel* cancel, Callback<std::string> h) {
+            finish_(cancel, std::move(h));
+        });
+}
+
+template<class Token>
+inline
+typename node::Result<Token, std::string>::type
+node::writer::async_finish(Cancel& cancel, Token&& token)
+{
+    return node::initiate<std::string>(token, &cancel,
+        [this] (Cancel* cancel, Callback<std::string> h) {
+            finish_(cancel, std::move(h));
+        });
 }
 
 } // namespace
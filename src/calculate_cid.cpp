@@ -0,0 +1,180 @@
+#include <asio_ipfs/calculate_cid.h>
+#include <vector>
+
+#include "sha256.h"
+
+using namespace std;
+using asio_ipfs::detail::sha256;
+
+// Mirrors go-unixfs' balanced layout (importer/balanced) with the default
+// go-ipfs-chunker size splitter and go-merkledag's dag-pb encoding.
+
+static const size_t chunk_size = 256 * 1024;
+static const size_t max_links  = 174; // helpers.DefaultLinksPerBlock
+
+namespace {
+
+struct Link {
+    sha256::digest hash;
+    uint64_t block_tree_size; // dag-pb Tsize: size of all blocks underneath
+    uint64_t file_size;       // UnixFS file bytes underneath
+};
+
+void put_varint(string& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+void put_key(string& out, unsigned field, unsigned wire_type)
+{
+    put_varint(out, field << 3 | wire_type);
+}
+
+void put_bytes(string& out, unsigned field, const void* data, size_t size)
+{
+    put_key(out, field, 2);
+    put_varint(out, size);
+    out.append(static_cast<const char*>(data), size);
+}
+
+void put_uint(string& out, unsigned field, uint64_t v)
+{
+    put_key(out, field, 0);
+    put_varint(out, v);
+}
+
+// The multihash prefix of a sha2-256 digest: <sha2-256 code><length>.
+const uint8_t mh_prefix[] = { 0x12, 0x20 };
+
+// UnixFS Data message of a file node.
+string unixfs_file( const char* data, size_t size
+                  , uint64_t file_size
+                  , const vector<Link>& children)
+{
+    string out;
+    put_uint(out, 1, 2); // Type = File
+    if (size) put_bytes(out, 2, data, size);
+    put_uint(out, 3, file_size);
+    for (auto& c : children) put_uint(out, 4, c.file_size); // blocksizes
+    return out;
+}
+
+// dag-pb PBNode. Links go before Data, as in go-merkledag.
+Link dag_pb_node(const string& unixfs, const vector<Link>& children, uint64_t file_size)
+{
+    string out;
+    uint64_t tree_size = 0;
+
+    for (auto& c : children) {
+        string link;
+        string hash(mh_prefix, mh_prefix + sizeof(mh_prefix));
+        hash.append(c.hash.begin(), c.hash.end());
+        put_bytes(link, 1, hash.data(), hash.size());
+        put_bytes(link, 2, "", 0); // Name, always present
+        put_uint(link, 3, c.block_tree_size);
+        put_bytes(out, 2, link.data(), link.size());
+        tree_size += c.block_tree_size;
+    }
+
+    put_bytes(out, 1, unixfs.data(), unixfs.size());
+
+    return Link{ sha256::hash(out.data(), out.size())
+               , tree_size + out.size()
+               , file_size };
+}
+
+class Builder {
+public:
+    Builder(boost::string_view data) : _data(data) {}
+
+    Link layout()
+    {
+        if (done()) return leaf();
+
+        Link root = leaf();
+
+        for (unsigned depth = 1; !done(); ++depth) {
+            root = fill({root}, depth);
+        }
+
+        return root;
+    }
+
+private:
+    bool done() const { return _pos >= _data.size(); }
+
+    Link leaf()
+    {
+        size_t size = min(chunk_size, _data.size() - _pos);
+        const char* chunk = _data.data() + _pos;
+        _pos += size;
+        return dag_pb_node(unixfs_file(chunk, size, size, {}), {}, size);
+    }
+
+    Link fill(vector<Link> children, unsigned depth)
+    {
+        while (children.size() < max_links && !done()) {
+            children.push_back(depth == 1 ? leaf() : fill({}, depth - 1));
+        }
+
+        uint64_t file_size = 0;
+        for (auto& c : children) file_size += c.file_size;
+
+        return dag_pb_node( unixfs_file(nullptr, 0, file_size, children)
+                          , children
+                          , file_size);
+    }
+
+private:
+    boost::string_view _data;
+    size_t _pos = 0;
+};
+
+string base58(const uint8_t* data, size_t size)
+{
+    static const char alphabet[] =
+        "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+    size_t zeros = 0;
+    while (zeros < size && data[zeros] == 0) ++zeros;
+
+    // log(256) / log(58) < 1.37
+    vector<uint8_t> digits((size - zeros) * 137 / 100 + 1);
+    size_t length = 0;
+
+    for (size_t i = zeros; i < size; ++i) {
+        unsigned carry = data[i];
+        size_t j = 0;
+
+        for (auto it = digits.rbegin(); (carry || j < length) && it != digits.rend(); ++it, ++j) {
+            carry += 256 * unsigned(*it);
+            *it = carry % 58;
+            carry /= 58;
+        }
+
+        length = j;
+    }
+
+    string out(zeros, '1');
+    for (auto it = digits.end() - length; it != digits.end(); ++it) {
+        out.push_back(alphabet[*it]);
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+string asio_ipfs::calculate_cid(boost::string_view data)
+{
+    Link root = Builder(data).layout();
+
+    uint8_t mh[sizeof(mh_prefix) + tuple_size<sha256::digest>::value];
+    copy(begin(mh_prefix), end(mh_prefix), mh);
+    copy(root.hash.begin(), root.hash.end(), mh + sizeof(mh_prefix));
+
+    return base58(mh, sizeof(mh));
+}
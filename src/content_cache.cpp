@@ -0,0 +1,104 @@
+#include "content_cache.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace asio_ipfs::detail;
+
+size_t content_cache::Hash::operator()(boost::string_view s) const
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : s) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    return h;
+}
+
+content_cache::content_cache(size_t max_bytes)
+    : _shard_budget(max_bytes / shard_count)
+{}
+
+content_cache::Shard& content_cache::shard(boost::string_view cid)
+{
+    // Use other bits than the ones the shard's hash table picks buckets by.
+    return _shards[(Hash()(cid) >> 16) % shard_count];
+}
+
+boost::optional<string> content_cache::get(boost::string_view cid)
+{
+    auto& s = shard(cid);
+    lock_guard<mutex> lock(s.mutex);
+
+    auto i = s.index.find(cid);
+
+    if (i == s.index.end()) {
+        ++s.misses;
+        return boost::none;
+    }
+
+    ++s.hits;
+    s.lru.splice(s.lru.begin(), s.lru, i->second);
+    return i->second->data;
+}
+
+boost::optional<string> content_cache::get_range( boost::string_view cid
+                                                , uint64_t offset
+                                                , uint64_t length)
+{
+    auto& s = shard(cid);
+    lock_guard<mutex> lock(s.mutex);
+
+    auto i = s.index.find(cid);
+
+    if (i == s.index.end()) return boost::none;
+
+    s.lru.splice(s.lru.begin(), s.lru, i->second);
+
+    auto& data = i->second->data;
+
+    if (offset >= data.size()) return string();
+
+    return data.substr(offset, min<uint64_t>(length, data.size() - offset));
+}
+
+void content_cache::put(boost::string_view cid, const string& data)
+{
+    size_t size = cid.size() + data.size();
+
+    if (size > _shard_budget / 8) return;
+
+    auto& s = shard(cid);
+    lock_guard<mutex> lock(s.mutex);
+
+    // Concurrent misses on the same CID all end up here.
+    if (s.index.count(cid)) return;
+
+    while (s.bytes + size > _shard_budget) {
+        auto& e = s.lru.back();
+        s.bytes -= e.cid.size() + e.data.size();
+        s.index.erase(e.cid);
+        s.lru.pop_back();
+        ++s.evictions;
+    }
+
+    s.lru.push_front(Entry{string(cid.data(), cid.size()), data});
+    s.index.emplace(s.lru.front().cid, s.lru.begin());
+    s.bytes += size;
+}
+
+content_cache::stats content_cache::get_stats() const
+{
+    stats ret;
+
+    for (auto& s : _shards) {
+        lock_guard<mutex> lock(s.mutex);
+        ret.hits      += s.hits;
+        ret.misses    += s.misses;
+        ret.evictions += s.evictions;
+        ret.entries   += s.lru.size();
+        ret.bytes     += s.bytes;
+    }
+
+    return ret;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
+
+namespace asio_ipfs { namespace detail {
+
+// Fully assembled content keyed by CID. Content behind a CID never changes,
+// so entries never need to be invalidated, only evicted. The cache is split
+// into independently locked LRU shards, each with an equal part of the byte
+// budget.
+class content_cache {
+public:
+    struct stats {
+        uint64_t hits      = 0;
+        uint64_t misses    = 0;
+        uint64_t evictions = 0;
+        uint64_t entries   = 0;
+        uint64_t bytes     = 0;
+    };
+
+    explicit content_cache(size_t max_bytes);
+
+    content_cache(const content_cache&) = delete;
+    content_cache& operator=(const content_cache&) = delete;
+
+    boost::optional<std::string> get(boost::string_view cid);
+
+    // The part of a cached entry starting at `offset`, at most `length`
+    // bytes of it. Ranges are never cached themselves, so this doesn't count
+    // towards the hit and miss statistics.
+    boost::optional<std::string> get_range( boost::string_view cid
+                                          , uint64_t offset
+                                          , uint64_t length);
+
+    // Entries larger than an eighth of a shard's budget are not cached, so
+    // that a single big file doesn't wipe the whole shard.
+    void put(boost::string_view cid, const std::string& data);
+
+    stats get_stats() const;
+
+private:
+    static const size_t shard_count = 8;
+
+    struct Entry {
+        std::string cid;
+        std::string data;
+    };
+
+    struct Hash {
+        size_t operator()(boost::string_view) const;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        // Most recently used at the front.
+        std::list<Entry> lru;
+        std::unordered_map< boost::string_view
+                          , std::list<Entry>::iterator
+                          , Hash> index;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    Shard& shard(boost::string_view cid);
+
+private:
+    size_t _shard_budget;
+    Shard _shards[shard_count];
+};
+
+}} // asio_ipfs::detail namespace
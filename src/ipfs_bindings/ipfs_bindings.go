@@ -8,13 +8,20 @@ import (
 	"fmt"
 	"context"
 	"os"
+	"path/filepath"
 	"sort"
 	"unsafe"
 	"time"
 	"io"
 	"strings"
+	"sync"
+	"sync/atomic"
 	"io/ioutil"
 	"encoding/json"
+	"encoding/base64"
+	"bytes"
+	"container/list"
+	"crypto/sha256"
 	core "github.com/ipfs/go-ipfs/core"
 	coreapi "github.com/ipfs/go-ipfs/core/coreapi"
 	coreiface "github.com/ipfs/interface-go-ipfs-core"
@@ -24,14 +31,35 @@ import (
 	plugin "github.com/ipfs/go-ipfs/plugin"
 	flatfs "github.com/ipfs/go-ipfs/plugin/plugins/flatfs"
 	levelds "github.com/ipfs/go-ipfs/plugin/plugins/levelds"
+	badgerds "github.com/ipfs/go-ipfs/plugin/plugins/badgerds"
+	keystore "github.com/ipfs/go-ipfs/keystore"
+	datastore "github.com/ipfs/go-datastore"
+	syncds "github.com/ipfs/go-datastore/sync"
 
 
 	"github.com/ipfs/go-ipfs-config"
 	"github.com/ipfs/interface-go-ipfs-core/options"
 
 	path "github.com/ipfs/go-path"
+	namesys "github.com/ipfs/go-ipfs/namesys"
+	ipns "github.com/ipfs/go-ipns"
+	ipns_pb "github.com/ipfs/go-ipns/pb"
+	proto "github.com/gogo/protobuf/proto"
 	peer "github.com/libp2p/go-libp2p-peer"
+	pstore "github.com/libp2p/go-libp2p-peerstore"
+	ci "github.com/libp2p/go-libp2p-crypto"
+	ma "github.com/multiformats/go-multiaddr"
 	files "github.com/ipfs/go-ipfs-files"
+	mh "github.com/multiformats/go-multihash"
+	cid "github.com/ipfs/go-cid"
+	corerepo "github.com/ipfs/go-ipfs/core/corerepo"
+	pin "github.com/ipfs/go-ipfs/pin"
+	gc "github.com/ipfs/go-ipfs/pin/gc"
+	bserv "github.com/ipfs/go-blockservice"
+	offline "github.com/ipfs/go-ipfs-exchange-offline"
+	dag "github.com/ipfs/go-merkledag"
+	ipld "github.com/ipfs/go-ipld-format"
+	blocks "github.com/ipfs/go-block-format"
 
 	mprome "github.com/ipfs/go-metrics-prometheus"
 	"github.com/prometheus/client_golang/prometheus"
@@ -56,11 +84,24 @@ import (
 //{
 //    ((void(*)(int, char*, size_t, void*)) func)(err, data, size, arg);
 //}
+//static void execute_progress_cb(void* func, uint64_t blocks, uint64_t bytes, uint64_t done, int last, void* arg)
+//{
+//    ((void(*)(uint64_t, uint64_t, uint64_t, int, void*)) func)(blocks, bytes, done, last, arg);
+//}
+//static int execute_claim_cb(void* func, void* arg)
+//{
+//    return ((int(*)(void*)) func)(arg);
+//}
 //#endif // if IN_GO
 import "C"
 
 const (
 	nBitsForKeypair = 2048
+
+	// config.Init always generates an RSA key. When it's going to be
+	// replaced by an ed25519 one anyway, make it the smallest config.Init
+	// accepts.
+	nBitsForDiscardedKeypair = 1024
 	repoRoot = "./repo"
 	debug = false
 
@@ -73,6 +114,33 @@ const (
 
 	// https://github.com/ipfs/go-ipfs/blob/master/docs/experimental-features.md#quic
 	enableQuic = true
+
+	// Upper bound on the amount of data a single reader read hands over to
+	// C, regardless of how big a buffer the caller offers.
+	maxReadChunk = 256 * 1024
+
+	// How many adds of a single batch run at the same time.
+	addBatchParallelism = 8
+
+	// How often a batched pin reports its progress.
+	pinProgressInterval = 100 * time.Millisecond
+
+	// Blocks removed per acquisition of the GC lock, adds and pins wait for
+	// at most this many deletions.
+	gcSliceBlocks = 64
+
+	// Automatic GC checks the repo size this often, and once above the
+	// watermark runs steps of `autoGCBudget` every `autoGCPause`.
+	autoGCInterval = time.Minute
+	autoGCBudget = 50 * time.Millisecond
+	autoGCPause = 200 * time.Millisecond
+
+	// Names kept in the IPNS resolve cache, the least recently used ones
+	// go first.
+	resolveCacheSize = 4096
+
+	// A background refresh of a cached name gives up after this long.
+	resolveRefreshTimeout = time.Minute
 )
 
 type Config struct {
@@ -80,6 +148,14 @@ type Config struct {
 	LowWater int
 	HighWater int
 	GracePeriod string
+	Filestore bool
+	Datastore string
+	PublishDebounce string
+	GCHighWatermark uint64
+	Identity string
+	LazyBootstrap bool
+	HttpApi bool
+	Bootstrap bool
 }
 
 func main() {
@@ -112,35 +188,146 @@ func setRandomPort(ep string) string {
 	return strings.Join(parts, "/")
 }
 
+func ed25519Identity() (config.Identity, error) {
+	sk, pk, err := ci.GenerateKeyPair(ci.Ed25519, 0)
+
+	if err != nil {
+		return config.Identity{}, err
+	}
+
+	id, err := peer.IDFromPublicKey(pk)
+
+	if err != nil {
+		return config.Identity{}, err
+	}
+
+	skbytes, err := sk.Bytes()
+
+	if err != nil {
+		return config.Identity{}, err
+	}
+
+	return config.Identity{
+		PeerID:  id.Pretty(),
+		PrivKey: base64.StdEncoding.EncodeToString(skbytes),
+	}, nil
+}
+
+func newRepoConfig(c Config) (*config.Config, error) {
+	var conf *config.Config
+	var err error
+
+	switch c.Identity {
+	case "", "rsa":
+		conf, err = config.Init(os.Stdout, nBitsForKeypair)
+	case "ed25519":
+		conf, err = config.Init(ioutil.Discard, nBitsForDiscardedKeypair)
+
+		if err == nil {
+			conf.Identity, err = ed25519Identity()
+		}
+	default:
+		err = fmt.Errorf("unknown identity type %q", c.Identity)
+	}
+
+	if err != nil {
+		return nil, err
+	}
+
+	// Don't use hardcoded swarm ports (usually 4001), otherwise
+	// we wouldn't be able to run multiple IPFS instances on the
+	// same PC.
+	for i, addr := range conf.Addresses.Swarm {
+		conf.Addresses.Swarm[i] = setRandomPort(addr)
+	}
+
+	if (enableQuic) {
+		conf.Experimental.QUIC = true
+		conf.Addresses.Swarm = append(conf.Addresses.Swarm, "/ip4/0.0.0.0/udp/0/quic")
+	}
+
+	conf.Swarm.ConnMgr.LowWater = c.LowWater
+	conf.Swarm.ConnMgr.HighWater = c.HighWater
+	conf.Swarm.ConnMgr.GracePeriod = c.GracePeriod
+	conf.Experimental.FilestoreEnabled = c.Filestore
+
+	switch c.Datastore {
+	case "", "flatfs":
+		// config.Init's default: flatfs for blocks, leveldb for the rest.
+	case "leveldb":
+		conf.Datastore.Spec = map[string]interface{}{
+			"type":   "measure",
+			"prefix": "leveldb.datastore",
+			"child": map[string]interface{}{
+				"type":        "levelds",
+				"path":        "datastore",
+				"compression": "none",
+			},
+		}
+	case "badger":
+		if err := config.Profiles["badgerds"].Transform(conf); err != nil {
+			return nil, err
+		}
+	case "memory":
+		// Nothing is stored on disk, see openOrCreateRepo.
+	default:
+		return nil, fmt.Errorf("unknown datastore %q", c.Datastore)
+	}
+
+	return conf, nil
+}
+
 func openOrCreateRepo(repoRoot string, c Config) (repo.Repo, error) {
-	if doesnt_exist_or_is_empty(repoRoot) {
-		conf, err := config.Init(os.Stdout, nBitsForKeypair)
+	if c.Datastore == "memory" {
+		conf, err := newRepoConfig(c)
 
 		if err != nil {
 			return nil, err
 		}
 
-		// Don't use hardcoded swarm ports (usually 4001), otherwise
-		// we wouldn't be able to run multiple IPFS instances on the
-		// same PC.
-		for i, addr := range conf.Addresses.Swarm {
-			conf.Addresses.Swarm[i] = setRandomPort(addr)
-		}
+		// The filestore needs a repo on disk.
+		conf.Experimental.FilestoreEnabled = false
 
-		if (enableQuic) {
-			conf.Experimental.QUIC = true
-			conf.Addresses.Swarm = append(conf.Addresses.Swarm, "/ip4/0.0.0.0/udp/0/quic")
-		}
+		return &repo.Mock{
+			C: *conf,
+			D: syncds.MutexWrap(datastore.NewMapDatastore()),
+			K: keystore.NewMemKeystore(),
+		}, nil
+	}
+
+	if doesnt_exist_or_is_empty(repoRoot) {
+		conf, err := newRepoConfig(c)
 
-		conf.Swarm.ConnMgr.LowWater = c.LowWater
-		conf.Swarm.ConnMgr.HighWater = c.HighWater
-		conf.Swarm.ConnMgr.GracePeriod = c.GracePeriod
+		if err != nil {
+			return nil, err
+		}
 
 		if err := fsrepo.Init(repoRoot, conf); err != nil {
 			return nil, err
 		}
 	}
 
+	r, err := fsrepo.Open(repoRoot)
+
+	if err != nil || !c.Filestore {
+		return r, err
+	}
+
+	conf, err := r.Config()
+
+	if err != nil || conf.Experimental.FilestoreEnabled {
+		return r, err
+	}
+
+	// The filestore is set up when the repo is opened, so an existing repo
+	// needs to be reopened after enabling it.
+	err = r.SetConfigKey("Experimental.FilestoreEnabled", true)
+	r.Close()
+
+	if err != nil {
+		return nil, err
+	}
+
 	return fsrepo.Open(repoRoot)
 }
 
@@ -160,22 +347,183 @@ func printSwarmAddrs(node *core.IpfsNode) {
 	}
 }
 
+const cancelShardCount = 16
+
+// Cancellation functions are registered and looked up from whichever thread
+// calls into Go, so they're spread over a few independently locked maps.
+type cancelShard struct {
+	mutex sync.Mutex
+	signals map[C.uint64_t]func()
+	// Timeouts of signals whose operation hasn't started yet.
+	timeouts map[C.uint64_t]time.Duration
+}
+
 type Node struct {
+	// Accessed atomically, must come first to be 64-bit aligned on 32-bit
+	// platforms.
+	next_cancel_signal_id uint64
+
 	node *core.IpfsNode
 	api coreiface.CoreAPI
 	ctx context.Context
 	cancel context.CancelFunc
 
-	next_cancel_signal_id C.uint64_t
-	cancel_signals map[C.uint64_t]func()
+	filestore bool
+
+	cancel_shards [cancelShardCount]cancelShard
+
+	// Guards the reader and writer tables.
+	mutex sync.Mutex
+
+	next_reader_id uint64
+	readers map[uint64]*reader
+
+	next_writer_id uint64
+	writers map[uint64]*writer
+
+	resolve_cache resolveCache
+
+	publisher publisher
+
+	gc gcState
+
+	// Nil unless bootstrapping is deferred.
+	bootstrap *lazyBootstrap
+
+	// Removes this node's Prometheus collector, nil if it has none.
+	unregisterMetrics func()
+}
+
+// Bootstrap peers of a node which only bootstraps once an operation may
+// need the network.
+type lazyBootstrap struct {
+	once  sync.Once
+	peers []pstore.PeerInfo
+}
+
+// go-ipfs bootstraps while the node is being built, from the peers in the
+// repo config. This hides them from the node.
+type noBootstrapRepo struct {
+	repo.Repo
+}
+
+func (r noBootstrapRepo) Config() (*config.Config, error) {
+	c, err := r.Repo.Config()
+
+	if err != nil {
+		return nil, err
+	}
+
+	ret := *c
+	ret.Bootstrap = nil
+	return &ret, nil
+}
+
+// "/ip4/1.2.3.4/tcp/4001/ipfs/Qm..." -> the peer and its address
+func parsePeerAddr(s string) (pstore.PeerInfo, error) {
+	addr, err := ma.NewMultiaddr(s)
+
+	if err != nil {
+		return pstore.PeerInfo{}, err
+	}
+
+	pi, err := pstore.InfoFromP2pAddr(addr)
+
+	if err != nil {
+		return pstore.PeerInfo{}, err
+	}
+
+	return *pi, nil
+}
+
+func parseBootstrapPeers(addrs []string) []pstore.PeerInfo {
+	var ret []pstore.PeerInfo
+
+	for _, s := range addrs {
+		pi, err := parsePeerAddr(s)
+
+		if err != nil {
+			fmt.Printf("Ignoring invalid bootstrap address %q: %v\n", s, err)
+			continue
+		}
+
+		ret = append(ret, pi)
+	}
+
+	return ret
+}
+
+// Called before anything which may need other peers. The first caller
+// bootstraps (and others wait for it), later calls return right away.
+func (n *Node) ensureBootstrapped() {
+	b := n.bootstrap
+
+	if b == nil {
+		return
+	}
+
+	b.once.Do(func() {
+		err := n.node.Bootstrap(core.BootstrapConfigWithPeers(b.peers))
+
+		if err != nil {
+			fmt.Println("Failed to bootstrap", err)
+		}
+	})
+}
+
+// State of a streaming `cat`. The file is opened lazily on the first read
+// and positioned at `offset`, `remaining` bytes are left to be read from it.
+// Reads are serialized through `mutex`, the scratch buffer is reused between
+// reads so memory stays bounded by `maxReadChunk` per reader.
+type reader struct {
+	cid string
+	offset uint64
+	remaining uint64
+	ctx context.Context
+	cancel context.CancelFunc
+
+	mutex sync.Mutex
+	file files.File
+	buf []byte
+}
+
+// State of a streaming `add`. Data written by C flows through an io.Pipe
+// straight into the UnixFS importer, so at any time only the chunk being
+// written and the importer's own chunker window are held in memory.
+type writer struct {
+	ctx context.Context
+	cancel context.CancelFunc
+
+	pipe *io.PipeWriter
+	// Closed once `result` is set, which it then stays for every `finish`.
+	done chan struct{}
+	result addResult
+}
+
+type addResult struct {
+	cid string
+	err error
+}
+
+func (w *writer) abort() {
+	w.cancel()
+	w.pipe.CloseWithError(context.Canceled)
 }
 
-// Both object tables, and assorted ID trackers,
-// are only ever accessed from the C thread.
+// The node table, and everything hanging off a node, may be accessed from
+// any number of C threads at once.
 
+var g_nodes_mutex sync.RWMutex
 var g_next_node_id uint64 = 0
 var g_nodes = make(map[uint64]*Node)
 
+func getNode(handle uint64) (*Node, bool) {
+	g_nodes_mutex.RLock()
+	defer g_nodes_mutex.RUnlock()
+
+	n, ok := g_nodes[handle]
+	return n, ok
+}
 
 //export go_asio_ipfs_allocate
 func go_asio_ipfs_allocate() uint64 {
@@ -183,8 +531,22 @@ func go_asio_ipfs_allocate() uint64 {
 
 	n.ctx, n.cancel = context.WithCancel(context.Background())
 
-	n.next_cancel_signal_id = 0
-	n.cancel_signals = make(map[C.uint64_t]func())
+	for i := range n.cancel_shards {
+		n.cancel_shards[i].signals = make(map[C.uint64_t]func())
+		n.cancel_shards[i].timeouts = make(map[C.uint64_t]time.Duration)
+	}
+
+	n.next_reader_id = 0
+	n.readers = make(map[uint64]*reader)
+
+	n.next_writer_id = 0
+	n.writers = make(map[uint64]*writer)
+
+	n.resolve_cache.entries = make(map[string]*list.Element)
+	n.resolve_cache.lru = list.New()
+
+	g_nodes_mutex.Lock()
+	defer g_nodes_mutex.Unlock()
 
 	ret := g_next_node_id
 	g_nodes[g_next_node_id] = &n
@@ -195,46 +557,156 @@ func go_asio_ipfs_allocate() uint64 {
 
 //export go_asio_ipfs_free
 func go_asio_ipfs_free(handle uint64) {
-	g_nodes[handle].cancel()
+	g_nodes_mutex.Lock()
+	n, ok := g_nodes[handle]
 	delete(g_nodes, handle)
+	g_nodes_mutex.Unlock()
+
+	if !ok {
+		return
+	}
+
+	if n.unregisterMetrics != nil {
+		n.unregisterMetrics()
+	}
+
+	n.cancel()
 }
 
 
+// A positive `timeout_ns` gives the operation started with the returned
+// signal a deadline, after which its context is done.
 //export go_asio_ipfs_cancellation_allocate
-func go_asio_ipfs_cancellation_allocate(handle uint64) C.uint64_t {
-	n, ok := g_nodes[handle]
+func go_asio_ipfs_cancellation_allocate(handle uint64, timeout_ns C.int64_t) C.uint64_t {
+	n, ok := getNode(handle)
 	if !ok { return C.uint64_t(1<<64 - 1 /* max uint64 */) }
 
-	ret := n.next_cancel_signal_id
-	n.next_cancel_signal_id += 1
-	return ret
+	cancel_signal := C.uint64_t(atomic.AddUint64(&n.next_cancel_signal_id, 1) - 1)
+
+	if timeout_ns > 0 {
+		shard := n.cancelShard(cancel_signal)
+		shard.mutex.Lock()
+		shard.timeouts[cancel_signal] = time.Duration(timeout_ns)
+		shard.mutex.Unlock()
+	}
+
+	return cancel_signal
+}
+
+func (n *Node) cancelShard(cancel_signal C.uint64_t) *cancelShard {
+	return &n.cancel_shards[uint64(cancel_signal) % cancelShardCount]
+}
+
+func (n *Node) setCancel(cancel_signal C.uint64_t, cancel func()) {
+	shard := n.cancelShard(cancel_signal)
+	shard.mutex.Lock()
+	shard.signals[cancel_signal] = cancel
+	shard.mutex.Unlock()
 }
 
 //export go_asio_ipfs_cancellation_free
 func go_asio_ipfs_cancellation_free(handle uint64, cancel_signal C.uint64_t) {
-	n, ok := g_nodes[handle]
+	n, ok := getNode(handle)
 	if !ok { return }
 
-	delete(n.cancel_signals, cancel_signal)
+	shard := n.cancelShard(cancel_signal)
+	shard.mutex.Lock()
+	delete(shard.signals, cancel_signal)
+	delete(shard.timeouts, cancel_signal)
+	shard.mutex.Unlock()
 }
 
 func withCancel(n *Node, cancel_signal C.uint64_t) (context.Context) {
-	ctx, cancel := context.WithCancel(n.ctx)
-	n.cancel_signals[cancel_signal] = cancel
+	shard := n.cancelShard(cancel_signal)
+	shard.mutex.Lock()
+	timeout, has_timeout := shard.timeouts[cancel_signal]
+	delete(shard.timeouts, cancel_signal)
+	shard.mutex.Unlock()
+
+	var ctx context.Context
+	var cancel context.CancelFunc
+
+	if has_timeout {
+		ctx, cancel = context.WithTimeout(n.ctx, timeout)
+	} else {
+		ctx, cancel = context.WithCancel(n.ctx)
+	}
+
+	n.setCancel(cancel_signal, cancel)
 	return ctx
 }
 
 //export go_asio_ipfs_cancel
 func go_asio_ipfs_cancel(handle uint64, cancel_signal C.uint64_t) {
-	n, ok := g_nodes[handle]
+	n, ok := getNode(handle)
 	if !ok { return }
 
-	cancel, ok := n.cancel_signals[cancel_signal]
+	shard := n.cancelShard(cancel_signal)
+	shard.mutex.Lock()
+	cancel, ok := shard.signals[cancel_signal]
+	shard.mutex.Unlock()
+
 	if !ok { return }
 
 	cancel()
 }
 
+func (n *Node) addReader(r *reader) uint64 {
+	n.mutex.Lock()
+	defer n.mutex.Unlock()
+
+	ret := n.next_reader_id
+	n.readers[ret] = r
+	n.next_reader_id += 1
+
+	return ret
+}
+
+func (n *Node) getReader(reader_id uint64) (*reader, bool) {
+	n.mutex.Lock()
+	defer n.mutex.Unlock()
+
+	r, ok := n.readers[reader_id]
+	return r, ok
+}
+
+func (n *Node) removeReader(reader_id uint64) (*reader, bool) {
+	n.mutex.Lock()
+	defer n.mutex.Unlock()
+
+	r, ok := n.readers[reader_id]
+	delete(n.readers, reader_id)
+	return r, ok
+}
+
+func (n *Node) addWriter(w *writer) uint64 {
+	n.mutex.Lock()
+	defer n.mutex.Unlock()
+
+	ret := n.next_writer_id
+	n.writers[ret] = w
+	n.next_writer_id += 1
+
+	return ret
+}
+
+func (n *Node) getWriter(writer_id uint64) (*writer, bool) {
+	n.mutex.Lock()
+	defer n.mutex.Unlock()
+
+	w, ok := n.writers[writer_id]
+	return w, ok
+}
+
+func (n *Node) removeWriter(writer_id uint64) (*writer, bool) {
+	n.mutex.Lock()
+	defer n.mutex.Unlock()
+
+	w, ok := n.writers[writer_id]
+	delete(n.writers, writer_id)
+	return w, ok
+}
+
 func loadPlugins(plugins []plugin.Plugin) bool {
 	for _, pl := range plugins {
 		if pl, ok := pl.(plugin.PluginDatastore); ok {
@@ -250,6 +722,50 @@ func loadPlugins(plugins []plugin.Plugin) bool {
 	return true
 }
 
+// Setup shared by all nodes in the process, done by whichever starts first.
+var g_plugins_once sync.Once
+var g_plugins_ok bool
+
+var g_metrics_once sync.Once
+var g_metrics_err error
+
+func loadAllPlugins() bool {
+	g_plugins_once.Do(func() {
+		g_plugins_ok = loadPlugins(flatfs.Plugins) &&
+			loadPlugins(levelds.Plugins) &&
+			loadPlugins(badgerds.Plugins)
+	})
+
+	return g_plugins_ok
+}
+
+func injectMetrics() error {
+	g_metrics_once.Do(func() {
+		g_metrics_err = mprome.Inject()
+	})
+
+	return g_metrics_err
+}
+
+// Collectors of different nodes are told apart by the peer id label, the
+// default registry would otherwise reject all but the first one.
+func (n *Node) registerMetrics() {
+	reg := prometheus.WrapRegistererWith(
+		prometheus.Labels{"peer_id": n.node.Identity.Pretty()},
+		prometheus.DefaultRegisterer)
+
+	collector := &corehttp.IpfsNodeCollector{Node: n.node}
+
+	if err := reg.Register(collector); err != nil {
+		if _, ok := err.(prometheus.AlreadyRegisteredError); !ok {
+			fmt.Println("Failed to register metrics", err)
+		}
+		return
+	}
+
+	n.unregisterMetrics = func() { reg.Unregister(collector) }
+}
+
 func start_node(cfg_json string, n *Node, repoRoot string) C.int {
 
 	var c Config
@@ -260,21 +776,22 @@ func start_node(cfg_json string, n *Node, repoRoot string) C.int {
 		return C.IPFS_FAILED_TO_CREATE_REPO
 	}
 
-	err = mprome.Inject()
+	if c.HttpApi {
+		err = injectMetrics()
 
-	if err != nil {
-		fmt.Println("err");
-		return C.IPFS_FAILED_TO_CREATE_REPO // FIXME
+		if err != nil {
+			fmt.Println("err");
+			return C.IPFS_FAILED_TO_CREATE_REPO // FIXME
+		}
 	}
 
-	pr1 := loadPlugins(flatfs.Plugins);
-	pr2 := loadPlugins(levelds.Plugins);
-
-	if !pr1 || !pr2 {
+	if !loadAllPlugins() {
 		fmt.Println("Failed to load plugins")
 		return C.IPFS_FAILED_TO_CREATE_REPO
 	}
 
+	n.filestore = c.Filestore && c.Datastore != "memory"
+
 	r, err := openOrCreateRepo(repoRoot, c);
 
 	if err != nil {
@@ -282,7 +799,28 @@ func start_node(cfg_json string, n *Node, repoRoot string) C.int {
 		return C.IPFS_FAILED_TO_CREATE_REPO
 	}
 
-	cfg, err := fsrepo.ConfigAt(repoRoot);
+	cfg, err := r.Config()
+
+	if err != nil {
+		fmt.Println("Failed to read the repo config", err)
+		r.Close()
+		return C.IPFS_FAILED_TO_CREATE_REPO
+	}
+
+	if c.HttpApi && len(cfg.Addresses.API) == 0 {
+		fmt.Println("The repo config has no API address")
+		r.Close()
+		return C.IPFS_FAILED_TO_CREATE_REPO
+	}
+
+	if c.Online {
+		if !c.Bootstrap {
+			r = noBootstrapRepo{r}
+		} else if c.LazyBootstrap {
+			n.bootstrap = &lazyBootstrap{peers: parseBootstrapPeers(cfg.Bootstrap)}
+			r = noBootstrapRepo{r}
+		}
+	}
 
 	n.node, err = core.NewNode(n.ctx, &core.BuildCfg{
 		Online: c.Online,
@@ -293,11 +831,19 @@ func start_node(cfg_json string, n *Node, repoRoot string) C.int {
 		},
 	})
 
+	if err != nil {
+		fmt.Println("Failed to start the node", err)
+		r.Close()
+		return C.IPFS_FAILED_TO_CREATE_REPO
+	}
+
 	n.node.IsDaemon = true
 
 	printSwarmAddrs(n.node)
 
-	prometheus.MustRegister(&corehttp.IpfsNodeCollector{Node: n.node})
+	if c.HttpApi {
+		n.registerMetrics()
+	}
 
 	api, err := coreapi.NewCoreAPI(n.node)
 
@@ -306,23 +852,37 @@ func start_node(cfg_json string, n *Node, repoRoot string) C.int {
 		return C.IPFS_FAILED_TO_CREATE_REPO
 	}
 
-	go func() {
-		apiAddr := cfg.Addresses.API[0]
-		err := corehttp.ListenAndServe(n.node, apiAddr, corehttp.MetricsScrapingOption("/debug/metrics/prometheus"))
+	if c.HttpApi {
+		go func() {
+			apiAddr := cfg.Addresses.API[0]
+			err := corehttp.ListenAndServe(n.node, apiAddr, corehttp.MetricsScrapingOption("/debug/metrics/prometheus"))
 
-		if err != nil {
-			fmt.Printf("Warning: failed to start API listener on %s\n", apiAddr);
-		}
-	}()
+			if err != nil {
+				fmt.Printf("Warning: failed to start API listener on %s\n", apiAddr);
+			}
+		}()
+	}
 
 	n.api = api
 
+	debounce, err := time.ParseDuration(c.PublishDebounce)
+	if err != nil {
+		debounce = 0
+	}
+
+	n.publisher.wake = make(chan struct{}, 1)
+	go n.publishLoop(debounce)
+
+	if c.GCHighWatermark > 0 {
+		go n.autoGC(c.GCHighWatermark)
+	}
+
 	return C.IPFS_SUCCESS
 }
 
 //export go_asio_ipfs_start_blocking
 func go_asio_ipfs_start_blocking(handle uint64, c_cfg *C.char, c_repoPath *C.char) C.int {
-	var n = g_nodes[handle]
+	n, _ := getNode(handle)
 
 	repoRoot := C.GoString(c_repoPath)
 	cfg := C.GoString(c_cfg)
@@ -332,7 +892,7 @@ func go_asio_ipfs_start_blocking(handle uint64, c_cfg *C.char, c_repoPath *C.cha
 
 //export go_asio_ipfs_start_async
 func go_asio_ipfs_start_async(handle uint64, c_cfg *C.char, c_repoPath *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
-	var n = g_nodes[handle]
+	n, _ := getNode(handle)
 
 	repoRoot := C.GoString(c_repoPath)
 	cfg := C.GoString(c_cfg)
@@ -348,7 +908,7 @@ func go_asio_ipfs_start_async(handle uint64, c_cfg *C.char, c_repoPath *C.char,
 // IMPORTANT: The returned value needs to be explicitly `free`d.
 //export go_asio_ipfs_node_id
 func go_asio_ipfs_node_id(handle uint64) *C.char {
-	var n = g_nodes[handle]
+	n, _ := getNode(handle)
 
 	pid, err := peer.IDFromPrivateKey(n.node.PrivateKey)
 
@@ -360,78 +920,1718 @@ func go_asio_ipfs_node_id(handle uint64) *C.char {
 	return cstr
 }
 
-//export go_asio_ipfs_resolve
-func go_asio_ipfs_resolve(handle uint64, cancel_signal C.uint64_t, c_ipns_id *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
-	var n = g_nodes[handle]
+// A resolved IPNS name. The entry may be served as is until `fresh_until`,
+// served while being refreshed in the background until `eol`, and is
+// useless after that.
+type resolveEntry struct {
+	name        string
+	cid         string
+	fresh_until time.Time
+	eol         time.Time
+	refreshing  bool
+}
 
-	ipns_id := C.GoString(c_ipns_id)
+type resolveCache struct {
+	mutex   sync.Mutex
+	entries map[string]*list.Element
+	// Of *resolveEntry, most recently used first.
+	lru     *list.List
+
+	hits             uint64
+	stale_hits       uint64
+	misses           uint64
+	refreshes        uint64
+	refresh_failures uint64
+	refresh_nanos    uint64
+}
 
-	cancel_ctx := withCancel(n, cancel_signal)
+// Resolves an IPNS name and returns how long the answer may be cached. For
+// peer ids the record is fetched directly, so that its TTL and validity are
+// known, other names (DNSLink) are cached for the namesys default.
+func resolveName(ctx context.Context, n *core.IpfsNode, name string) (string, time.Duration, time.Time, error) {
+	now := time.Now()
+	ttl := namesys.DefaultResolverCacheTTL
+	eol := now.Add(ttl)
+	p := path.Path("/ipns/" + name)
+
+	if pid, err := peer.IDB58Decode(name); err == nil {
+		raw, err := n.Routing.GetValue(ctx, ipns.RecordKey(pid))
+		if err != nil {
+			return "", 0, eol, err
+		}
 
-	go func() {
-		if debug {
-			fmt.Println("go_asio_ipfs_resolve start");
-			defer fmt.Println("go_asio_ipfs_resolve end");
+		entry := new(ipns_pb.IpnsEntry)
+		if err := proto.Unmarshal(raw, entry); err != nil {
+			return "", 0, eol, err
 		}
 
-		n := n.node
-		p := path.Path("/ipns/" + ipns_id)
+		if eol, err = ipns.GetEOL(entry); err != nil {
+			return "", 0, eol, err
+		}
 
-		node, err := core.Resolve(cancel_ctx, n.Namesys, n.Resolver, p)
+		if entry.Ttl != nil {
+			ttl = time.Duration(entry.GetTtl())
+		}
 
-		if err != nil {
-			C.execute_data_cb(fn, C.IPFS_RESOLVE_FAILED, nil, C.size_t(0), fn_arg)
-			return
+		if p, err = path.ParsePath(string(entry.GetValue())); err != nil {
+			return "", 0, eol, err
 		}
+	}
 
-		data := []byte(node.Cid().String())
-		cdata := C.CBytes(data)
-		defer C.free(cdata)
+	node, err := core.Resolve(ctx, n.Namesys, n.Resolver, p)
+	if err != nil {
+		return "", 0, eol, err
+	}
 
-		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(data)), fn_arg)
-	}()
+	return node.Cid().String(), ttl, eol, nil
 }
 
-func publish(ctx context.Context, duration time.Duration, n *core.IpfsNode, cid string) error {
+func (c *resolveCache) store(name string, cid string, ttl time.Duration, eol time.Time) {
+	fresh_until := time.Now().Add(ttl)
+	if fresh_until.After(eol) {
+		fresh_until = eol
+	}
+
+	c.mutex.Lock()
+	defer c.mutex.Unlock()
+
+	e := &resolveEntry{name: name, cid: cid, fresh_until: fresh_until, eol: eol}
+
+	if el, ok := c.entries[name]; ok {
+		el.Value = e
+		c.lru.MoveToFront(el)
+		return
+	}
+
+	c.entries[name] = c.lru.PushFront(e)
+
+	if c.lru.Len() > resolveCacheSize {
+		c.remove(c.lru.Back())
+	}
+}
+
+func (c *resolveCache) remove(el *list.Element) {
+	c.lru.Remove(el)
+	delete(c.entries, el.Value.(*resolveEntry).name)
+}
+
+// Returns the cached CID, if any, and whether the caller has to refresh it.
+func (c *resolveCache) lookup(name string) (string, bool, bool) {
+	c.mutex.Lock()
+	defer c.mutex.Unlock()
+
+	now := time.Now()
+	el, ok := c.entries[name]
+
+	if !ok {
+		c.misses += 1
+		return "", false, false
+	}
+
+	e := el.Value.(*resolveEntry)
+
+	if !now.Before(e.eol) {
+		c.remove(el)
+		c.misses += 1
+		return "", false, false
+	}
+
+	c.lru.MoveToFront(el)
+
+	if now.Before(e.fresh_until) {
+		c.hits += 1
+		return e.cid, true, false
+	}
+
+	c.stale_hits += 1
+
+	if e.refreshing {
+		return e.cid, true, false
+	}
+
+	e.refreshing = true
+	return e.cid, true, true
+}
+
+func (n *Node) refreshName(name string) {
+	n.ensureBootstrapped()
+
+	// Until this is done no other refresh of the name is started.
+	ctx, cancel := context.WithTimeout(n.ctx, resolveRefreshTimeout)
+	defer cancel()
+
+	start := time.Now()
+	cid, ttl, eol, err := resolveName(ctx, n.node, name)
+	elapsed := time.Since(start)
+
+	if err == nil {
+		n.resolve_cache.store(name, cid, ttl, eol)
+	}
+
+	c := &n.resolve_cache
+	c.mutex.Lock()
+	defer c.mutex.Unlock()
+
+	c.refreshes += 1
+	c.refresh_nanos += uint64(elapsed.Nanoseconds())
+
+	if err != nil {
+		c.refresh_failures += 1
+		if el, ok := c.entries[name]; ok {
+			el.Value.(*resolveEntry).refreshing = false
+		}
+	}
+}
+
+//export go_asio_ipfs_resolve
+func go_asio_ipfs_resolve(handle uint64, cancel_signal C.uint64_t, c_ipns_id *C.char, fresh bool, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	ipns_id := C.GoString(c_ipns_id)
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_resolve start");
+			defer fmt.Println("go_asio_ipfs_resolve end");
+		}
+
+		var cid string
+		var found, refresh bool
+
+		if !fresh {
+			cid, found, refresh = n.resolve_cache.lookup(ipns_id)
+		}
+
+		if refresh {
+			go n.refreshName(ipns_id)
+		}
+
+		if !found {
+			var ttl time.Duration
+			var eol time.Time
+			var err error
+
+			n.ensureBootstrapped()
+
+			cid, ttl, eol, err = resolveName(cancel_ctx, n.node, ipns_id)
+
+			if err != nil {
+				C.execute_data_cb(fn, C.IPFS_RESOLVE_FAILED, nil, C.size_t(0), fn_arg)
+				return
+			}
+
+			n.resolve_cache.store(ipns_id, cid, ttl, eol)
+		}
+
+		data := []byte(cid)
+		cdata := C.CBytes(data)
+		defer C.free(cdata)
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(data)), fn_arg)
+	}()
+}
+
+// Fills `out` with hits, stale hits, misses, background refreshes, failed
+// refreshes and the total time spent refreshing in nanoseconds.
+//export go_asio_ipfs_resolve_cache_stats
+func go_asio_ipfs_resolve_cache_stats(handle uint64, out *C.uint64_t) {
+	n, ok := getNode(handle)
+	if !ok { return }
+
+	c := &n.resolve_cache
+	c.mutex.Lock()
+	defer c.mutex.Unlock()
+
+	stats := (*[6]C.uint64_t)(unsafe.Pointer(out))
+	stats[0] = C.uint64_t(c.hits)
+	stats[1] = C.uint64_t(c.stale_hits)
+	stats[2] = C.uint64_t(c.misses)
+	stats[3] = C.uint64_t(c.refreshes)
+	stats[4] = C.uint64_t(c.refresh_failures)
+	stats[5] = C.uint64_t(c.refresh_nanos)
+}
+
+func publish(ctx context.Context, duration time.Duration, n *core.IpfsNode, cid string) error {
 	path, err := path.ParseCidToPath(cid)
 
-	if err != nil {
-		fmt.Println("go_asio_ipfs_publish failed to parse cid \"", cid, "\"");
-		return err
+	if err != nil {
+		fmt.Println("go_asio_ipfs_publish failed to parse cid \"", cid, "\"");
+		return err
+	}
+
+	k := n.PrivateKey
+
+	eol := time.Now().Add(duration)
+	err  = n.Namesys.PublishWithEOL(ctx, k, path, eol)
+
+	if err != nil {
+		fmt.Println("go_asio_ipfs_publish failed");
+		return err
+	}
+
+	return nil
+}
+
+type publishRequest struct {
+	cid      string
+	duration time.Duration
+	ctx      context.Context
+	done     func(error)
+	// Only stops republishing, nothing gets published.
+	stop     bool
+}
+
+// Records valid for less than twice this long aren't republished, they are
+// left to expire.
+const minRepublishInterval = 10 * time.Second
+
+// Serializes IPNS publishing. Requests arriving within the debounce window
+// are collapsed into one publish of the newest of them, after which all of
+// them complete. The last published value is republished before it expires,
+// until a request to stop republishing comes after it.
+type publisher struct {
+	mutex   sync.Mutex
+	pending []*publishRequest
+	wake    chan struct{}
+}
+
+func (p *publisher) submit(r *publishRequest) {
+	p.mutex.Lock()
+	p.pending = append(p.pending, r)
+	p.mutex.Unlock()
+
+	select {
+	case p.wake <- struct{}{}:
+	default:
+	}
+}
+
+func (p *publisher) take() []*publishRequest {
+	p.mutex.Lock()
+	defer p.mutex.Unlock()
+
+	ret := p.pending
+	p.pending = nil
+	return ret
+}
+
+// A context which is done once all of `batch` are, or `parent` is.
+func batchContext(parent context.Context, batch []*publishRequest) (context.Context, context.CancelFunc) {
+	ctx, cancel := context.WithCancel(parent)
+
+	go func() {
+		for _, r := range batch {
+			select {
+			case <-r.ctx.Done():
+			case <-ctx.Done():
+				return
+			}
+		}
+		cancel()
+	}()
+
+	return ctx, cancel
+}
+
+func (n *Node) publishLoop(debounce time.Duration) {
+	p := &n.publisher
+
+	republish := time.NewTimer(time.Hour)
+	republish.Stop()
+
+	stopRepublish := func() {
+		if !republish.Stop() {
+			select {
+			case <-republish.C:
+			default:
+			}
+		}
+	}
+
+	var last *publishRequest
+
+	for {
+		select {
+		case <-n.ctx.Done():
+			for _, r := range p.take() {
+				if !r.stop {
+					r.done(n.ctx.Err())
+				}
+			}
+			return
+
+		case <-p.wake:
+			if debounce > 0 {
+				select {
+				case <-time.After(debounce):
+				case <-n.ctx.Done():
+					continue
+				}
+			}
+
+			var newest *publishRequest
+			var live []*publishRequest
+			stop := false
+
+			for _, r := range p.take() {
+				if r.stop {
+					stop = true
+					continue
+				}
+				if r.ctx.Err() != nil {
+					r.done(r.ctx.Err())
+					continue
+				}
+				live = append(live, r)
+				newest = r
+				stop = false
+			}
+
+			if stop {
+				stopRepublish()
+				last = nil
+			}
+
+			if newest == nil {
+				continue
+			}
+
+			n.ensureBootstrapped()
+
+			// Superseded requests share the outcome of the newest one,
+			// which is only given up on once all of them are cancelled.
+			ctx, cancel := batchContext(n.ctx, live)
+			err := publish(ctx, newest.duration, n.node, newest.cid)
+			cancel()
+
+			for _, r := range live {
+				r.done(err)
+			}
+
+			if err == nil {
+				stopRepublish()
+				last = nil
+
+				if !stop && newest.duration/2 >= minRepublishInterval {
+					last = newest
+					republish.Reset(last.duration / 2)
+				}
+			}
+
+		case <-republish.C:
+			if last == nil {
+				continue
+			}
+
+			if err := publish(n.ctx, last.duration, n.node, last.cid); err != nil {
+				republish.Reset(time.Minute)
+			} else {
+				republish.Reset(last.duration / 2)
+			}
+		}
+	}
+}
+
+//export go_asio_ipfs_publish
+func go_asio_ipfs_publish(handle uint64, cancel_signal C.uint64_t, cid *C.char, cid_size C.size_t, seconds C.int64_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	id := C.GoStringN(cid, C.int(cid_size))
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	n.publisher.submit(&publishRequest{
+		cid: id,
+		// https://stackoverflow.com/questions/17573190/how-to-multiply-duration-by-integer
+		duration: time.Duration(seconds) * time.Second,
+		ctx: cancel_ctx,
+		done: func(err error) {
+			if err != nil {
+				C.execute_void_cb(fn, C.IPFS_PUBLISH_FAILED, fn_arg)
+				return
+			}
+
+			C.execute_void_cb(fn, C.IPFS_SUCCESS, fn_arg)
+		},
+	})
+}
+
+//export go_asio_ipfs_stop_republishing
+func go_asio_ipfs_stop_republishing(handle uint64) {
+	n, ok := getNode(handle)
+	if !ok { return }
+
+	n.publisher.submit(&publishRequest{stop: true})
+}
+
+// An incremental garbage collection pass. Unpinned blocks are found once,
+// at the start of the pass, and then deleted a few at a time across steps.
+// Should the set of pins change in between, the pass starts over, as some
+// of the candidates may have become reachable.
+type gcState struct {
+	mutex       sync.Mutex
+	fingerprint [sha256.Size]byte
+	// Nil if no pass is in progress.
+	candidates []cid.Cid
+}
+
+type gcResult struct {
+	blocks   uint64
+	bytes    uint64
+	duration time.Duration
+	complete bool
+}
+
+func pinFingerprint(pn pin.Pinner) [sha256.Size]byte {
+	var keys []string
+
+	for _, c := range pn.RecursiveKeys() {
+		keys = append(keys, "r"+c.KeyString())
+	}
+
+	for _, c := range pn.DirectKeys() {
+		keys = append(keys, "d"+c.KeyString())
+	}
+
+	sort.Strings(keys)
+
+	h := sha256.New()
+	for _, k := range keys {
+		h.Write([]byte(k))
+	}
+
+	var ret [sha256.Size]byte
+	copy(ret[:], h.Sum(nil))
+	return ret
+}
+
+// Must be called with `n.gc.mutex` held.
+func (n *Node) gcMark(ctx context.Context) error {
+	g := &n.gc
+	bs := n.node.Blockstore
+
+	g.fingerprint = pinFingerprint(n.node.Pinning)
+
+	roots, err := corerepo.BestEffortRoots(n.node.FilesRoot)
+	if err != nil {
+		return err
+	}
+
+	// Never fetch anything while marking.
+	ng := dag.NewDAGService(bserv.New(bs, offline.Exchange(bs)))
+
+	// Only reports failures to walk the best effort roots.
+	output := make(chan gc.Result)
+	go func() {
+		for range output {
+		}
+	}()
+
+	marked, err := gc.ColoredSet(ctx, n.node.Pinning, ng, roots, output)
+	close(output)
+
+	if err != nil {
+		return err
+	}
+
+	keys, err := bs.AllKeysChan(ctx)
+	if err != nil {
+		return err
+	}
+
+	candidates := []cid.Cid{}
+
+	for c := range keys {
+		if !marked.Has(c) {
+			candidates = append(candidates, c)
+		}
+	}
+
+	g.candidates = candidates
+	return ctx.Err()
+}
+
+// Deletes unpinned blocks until either the pass completes, `budget` time
+// has passed, or `max_blocks` blocks have been deleted. Zero means no limit.
+// Marking at the start of a pass is not bounded by the budget.
+func (n *Node) gcStep(ctx context.Context, budget time.Duration, max_blocks uint64) (gcResult, error) {
+	g := &n.gc
+	g.mutex.Lock()
+	defer g.mutex.Unlock()
+
+	var ret gcResult
+	start := time.Now()
+	bs := n.node.Blockstore
+	remarked := false
+
+	if g.candidates == nil {
+		if err := n.gcMark(ctx); err != nil {
+			g.candidates = nil
+			return ret, err
+		}
+		remarked = true
+	}
+
+	for len(g.candidates) > 0 {
+		if max_blocks > 0 && ret.blocks >= max_blocks {
+			break
+		}
+
+		if budget > 0 && time.Since(start) >= budget {
+			break
+		}
+
+		if ctx.Err() != nil {
+			break
+		}
+
+		unlocker := bs.GCLock()
+
+		if pinFingerprint(n.node.Pinning) != g.fingerprint {
+			unlocker.Unlock()
+
+			// Don't keep re-marking under a steady stream of pins.
+			if remarked {
+				break
+			}
+
+			if err := n.gcMark(ctx); err != nil {
+				g.candidates = nil
+				return ret, err
+			}
+
+			remarked = true
+			continue
+		}
+
+		for i := 0; i < gcSliceBlocks && len(g.candidates) > 0; i++ {
+			c := g.candidates[len(g.candidates)-1]
+			g.candidates = g.candidates[:len(g.candidates)-1]
+
+			size, err := bs.GetSize(c)
+			if err != nil {
+				continue
+			}
+
+			if bs.DeleteBlock(c) == nil {
+				ret.blocks += 1
+				ret.bytes += uint64(size)
+			}
+		}
+
+		unlocker.Unlock()
+	}
+
+	if len(g.candidates) == 0 {
+		g.candidates = nil
+		ret.complete = true
+	}
+
+	ret.duration = time.Since(start)
+	return ret, nil
+}
+
+// Collects garbage in small steps whenever the repo grows above `high`
+// bytes, until the pass completes.
+func (n *Node) autoGC(high uint64) {
+	ticker := time.NewTicker(autoGCInterval)
+	defer ticker.Stop()
+
+	for {
+		select {
+		case <-n.ctx.Done():
+			return
+		case <-ticker.C:
+		}
+
+		usage, err := n.node.Repo.GetStorageUsage()
+		if err != nil || usage < high {
+			continue
+		}
+
+		for {
+			ret, err := n.gcStep(n.ctx, autoGCBudget, 0)
+			if err != nil || ret.complete {
+				break
+			}
+
+			select {
+			case <-n.ctx.Done():
+				return
+			case <-time.After(autoGCPause):
+			}
+		}
+	}
+}
+
+// The result is passed to `fn` as four uint64_t values: blocks deleted,
+// bytes freed, nanoseconds spent and whether the pass has completed.
+//export go_asio_ipfs_gc
+func go_asio_ipfs_gc(handle uint64, cancel_signal C.uint64_t, budget_ns C.int64_t, max_blocks C.uint64_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_gc start");
+			defer fmt.Println("go_asio_ipfs_gc end");
+		}
+
+		ret, err := n.gcStep(cancel_ctx, time.Duration(budget_ns), uint64(max_blocks))
+
+		if err != nil {
+			fmt.Println("go_asio_ipfs_gc failed ", err)
+			C.execute_data_cb(fn, C.IPFS_GC_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		var complete uint64
+		if ret.complete {
+			complete = 1
+		}
+
+		cdata := C.malloc(4 * 8)
+		defer C.free(cdata)
+
+		out := (*[4]C.uint64_t)(cdata)
+		out[0] = C.uint64_t(ret.blocks)
+		out[1] = C.uint64_t(ret.bytes)
+		out[2] = C.uint64_t(ret.duration.Nanoseconds())
+		out[3] = C.uint64_t(complete)
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(4 * 8), fn_arg)
+	}()
+}
+
+// Mirrors asio_ipfs::node::add_options, unset fields keep go-ipfs' defaults.
+type addOptions struct {
+	OnlyHash   bool
+	Chunker    string
+	RawLeaves  *bool
+	CidVersion *int
+	Hash       string
+}
+
+func parseAddOptions(c_opts *C.char) ([]options.UnixfsAddOption, error) {
+	var o addOptions
+
+	if err := json.Unmarshal([]byte(C.GoString(c_opts)), &o); err != nil {
+		return nil, err
+	}
+
+	ret := []options.UnixfsAddOption{options.Unixfs.HashOnly(o.OnlyHash)}
+
+	if o.Chunker != "" {
+		ret = append(ret, options.Unixfs.Chunker(o.Chunker))
+	}
+
+	if o.RawLeaves != nil {
+		ret = append(ret, options.Unixfs.RawLeaves(*o.RawLeaves))
+	}
+
+	if o.CidVersion != nil {
+		ret = append(ret, options.Unixfs.CidVersion(*o.CidVersion))
+	}
+
+	if o.Hash != "" {
+		code, ok := mh.Names[o.Hash]
+
+		if !ok {
+			return nil, fmt.Errorf("unsupported hash function %q", o.Hash)
+		}
+
+		ret = append(ret, options.Unixfs.Hash(code))
+	}
+
+	return ret, nil
+}
+
+//export go_asio_ipfs_add
+func go_asio_ipfs_add(handle uint64, data unsafe.Pointer, size C.size_t, c_opts *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	msg := C.GoBytes(data, C.int(size))
+	opts, opts_err := parseAddOptions(c_opts)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_add start");
+			defer fmt.Println("go_asio_ipfs_add end");
+		}
+
+		if opts_err != nil {
+			fmt.Println("Error: invalid add options ", opts_err)
+			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+			return;
+		}
+
+		p, err := n.api.Unixfs().Add(n.node.Context(), files.NewBytesFile(msg), opts...)
+
+		if err != nil {
+			fmt.Println("Error: failed to insert content ", err)
+			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+			return;
+		}
+
+		cid := p.Root()
+
+		if err != nil {
+			fmt.Println("Error: failed to parse IPFS path ", err)
+			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+			return;
+		}
+
+		cidstr := cid.String()
+		cdata := C.CBytes([]byte(cidstr))
+		defer C.free(cdata)
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(cidstr)), fn_arg)
+	}()
+}
+
+// Adds `count` blobs with a single crossing from C. The CIDs are returned
+// newline separated, in the same order as the input.
+//export go_asio_ipfs_add_batch
+func go_asio_ipfs_add_batch(handle uint64, c_datas *unsafe.Pointer, c_sizes *C.size_t, count C.size_t, c_opts *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	opts, opts_err := parseAddOptions(c_opts)
+
+	msgs := make([][]byte, int(count))
+
+	if count > 0 {
+		datas := (*[1 << 28]unsafe.Pointer)(unsafe.Pointer(c_datas))[:count:count]
+		sizes := (*[1 << 28]C.size_t)(unsafe.Pointer(c_sizes))[:count:count]
+
+		for i := range msgs {
+			msgs[i] = C.GoBytes(datas[i], C.int(sizes[i]))
+		}
+	}
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_add_batch start");
+			defer fmt.Println("go_asio_ipfs_add_batch end");
+		}
+
+		if opts_err != nil {
+			fmt.Println("Error: invalid add options ", opts_err)
+			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		cids := make([]string, len(msgs))
+		errs := make([]error, len(msgs))
+
+		var wg sync.WaitGroup
+		sem := make(chan struct{}, addBatchParallelism)
+
+		for i := range msgs {
+			wg.Add(1)
+			sem <- struct{}{}
+
+			go func(i int) {
+				defer func() { <-sem; wg.Done() }()
+
+				p, err := n.api.Unixfs().Add(n.node.Context(), files.NewBytesFile(msgs[i]), opts...)
+
+				if err != nil {
+					errs[i] = err
+					return
+				}
+
+				cids[i] = p.Root().String()
+			}(i)
+		}
+
+		wg.Wait()
+
+		for _, err := range errs {
+			if err != nil {
+				fmt.Println("Error: failed to insert content ", err)
+				C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+				return
+			}
+		}
+
+		data := []byte(strings.Join(cids, "\n"))
+
+		if len(data) == 0 {
+			C.execute_data_cb(fn, C.IPFS_SUCCESS, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, unsafe.Pointer(&data[0]), C.size_t(len(data)), fn_arg)
+	}()
+}
+
+// Returns the UnixFS file at `cid` or an IPFS_* error code.
+func getFile(ctx context.Context, n *Node, cid string) (files.File, C.int) {
+	n.ensureBootstrapped()
+
+	path, err := coreiface.ParsePath(cid);
+
+	if err != nil {
+		fmt.Printf("go_asio_ipfs_cat failed to parse cid %q\n", err);
+		return nil, C.IPFS_CAT_FAILED
+	}
+
+	f, err := n.api.Unixfs().Get(ctx, path)
+
+	if err != nil {
+		fmt.Printf("go_asio_ipfs_cat failed to Cat %q\n", err);
+		return nil, C.IPFS_CAT_FAILED
+	}
+
+	switch f := f.(type) {
+	case files.File:
+		return f, C.IPFS_SUCCESS
+	case files.Directory:
+		fmt.Printf("go_asio_ipfs_cat path corresponds to a directory\n");
+		return nil, C.IPFS_CAT_FAILED
+	default:
+		fmt.Printf("go_asio_ipfs_cat unsupported type\n");
+		return nil, C.IPFS_CAT_FAILED
+	}
+}
+
+func addFile(ctx context.Context, n *Node, path string, opts []options.UnixfsAddOption, nocopy bool) (string, error) {
+	f, err := os.Open(path)
+
+	if err != nil {
+		return "", err
+	}
+
+	defer f.Close()
+
+	st, err := f.Stat()
+
+	if err != nil {
+		return "", err
+	}
+
+	file, err := files.NewReaderPathFile(path, f, st)
+
+	if err != nil {
+		return "", err
+	}
+
+	p, err := n.api.Unixfs().Add(ctx, file, append(opts, options.Unixfs.Nocopy(nocopy))...)
+
+	if err != nil {
+		return "", err
+	}
+
+	return p.Root().String(), nil
+}
+
+// The file is read by the importer straight from disk, it is never loaded
+// into memory as a whole. With the filestore enabled the blocks only
+// reference the file instead of copying its content into the repo.
+//export go_asio_ipfs_add_file
+func go_asio_ipfs_add_file(handle uint64, cancel_signal C.uint64_t, c_path *C.char, c_opts *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	path := C.GoString(c_path)
+	opts, opts_err := parseAddOptions(c_opts)
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_add_file start");
+			defer fmt.Println("go_asio_ipfs_add_file end");
+		}
+
+		if opts_err != nil {
+			fmt.Println("Error: invalid add options ", opts_err)
+			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		path, err := filepath.Abs(path)
+
+		if err != nil {
+			fmt.Println("Error: failed to add file ", err)
+			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		cid, err := addFile(cancel_ctx, n, path, opts, n.filestore)
+
+		if err != nil && n.filestore && cancel_ctx.Err() == nil {
+			// Filestore only accepts files under the repo's parent
+			// directory, fall back to a regular add for the rest.
+			fmt.Println("Warning: failed to add file without copying ", err)
+			cid, err = addFile(cancel_ctx, n, path, opts, false)
+		}
+
+		if err != nil {
+			fmt.Println("Error: failed to add file ", err)
+			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		cdata := C.CBytes([]byte(cid))
+		defer C.free(cdata)
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(cid)), fn_arg)
+	}()
+}
+
+//export go_asio_ipfs_writer_allocate
+func go_asio_ipfs_writer_allocate(handle uint64, c_opts *C.char) uint64 {
+	n, _ := getNode(handle)
+
+	var w writer
+	w.ctx, w.cancel = context.WithCancel(n.ctx)
+	w.done = make(chan struct{})
+
+	pr, pw := io.Pipe()
+	w.pipe = pw
+
+	opts, opts_err := parseAddOptions(c_opts)
+
+	go func() {
+		defer close(w.done)
+
+		if opts_err != nil {
+			pr.CloseWithError(opts_err)
+			w.result = addResult{"", opts_err}
+			return
+		}
+
+		p, err := n.api.Unixfs().Add(w.ctx, files.NewReaderFile(pr), opts...)
+
+		if err != nil {
+			// Unblock any pending write.
+			pr.CloseWithError(err)
+			w.result = addResult{"", err}
+			return
+		}
+
+		w.result = addResult{p.Root().String(), nil}
+	}()
+
+	return n.addWriter(&w)
+}
+
+//export go_asio_ipfs_writer_free
+func go_asio_ipfs_writer_free(handle uint64, writer_id uint64) {
+	n, ok := getNode(handle)
+	if !ok { return }
+
+	w, ok := n.removeWriter(writer_id)
+	if !ok { return }
+
+	w.abort()
+}
+
+// Completes once the importer has consumed all of `data`. The data is copied
+// before this function returns, so C may reuse the buffer right away.
+//export go_asio_ipfs_writer_write
+func go_asio_ipfs_writer_write(handle uint64, cancel_signal C.uint64_t, writer_id uint64, data unsafe.Pointer, size C.size_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	w, ok := n.getWriter(writer_id)
+
+	if !ok {
+		C.execute_void_cb(fn, C.IPFS_ADD_FAILED, fn_arg)
+		return
+	}
+
+	n.setCancel(cancel_signal, w.abort)
+
+	msg := C.GoBytes(data, C.int(size))
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_writer_write start");
+			defer fmt.Println("go_asio_ipfs_writer_write end");
+		}
+
+		_, err := w.pipe.Write(msg)
+
+		if err != nil {
+			fmt.Println("Error: failed to write content ", err)
+			C.execute_void_cb(fn, C.IPFS_ADD_FAILED, fn_arg)
+			return
+		}
+
+		C.execute_void_cb(fn, C.IPFS_SUCCESS, fn_arg)
+	}()
+}
+
+//export go_asio_ipfs_writer_finish
+func go_asio_ipfs_writer_finish(handle uint64, cancel_signal C.uint64_t, writer_id uint64, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	w, ok := n.getWriter(writer_id)
+
+	if !ok {
+		C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+		return
+	}
+
+	n.setCancel(cancel_signal, w.abort)
+
+	w.pipe.Close()
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_writer_finish start");
+			defer fmt.Println("go_asio_ipfs_writer_finish end");
+		}
+
+		// The importer always ends, `w.ctx` is cancelled at the latest
+		// when the node goes away.
+		<-w.done
+		r := w.result
+
+		if r.err != nil {
+			fmt.Println("Error: failed to insert content ", r.err)
+			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		cdata := C.CBytes([]byte(r.cid))
+		defer C.free(cdata)
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(r.cid)), fn_arg)
+	}()
+}
+
+//export go_asio_ipfs_cat
+func go_asio_ipfs_cat(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, cid_size C.size_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	cid := C.GoStringN(c_cid, C.int(cid_size))
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_cat start");
+			defer fmt.Println("go_asio_ipfs_cat end");
+		}
+
+		file, ec := getFile(cancel_ctx, n, cid)
+
+		if ec != C.IPFS_SUCCESS {
+			C.execute_data_cb(fn, ec, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		var r io.Reader = file
+		bytes, err := ioutil.ReadAll(r)
+
+		if err != nil {
+			fmt.Println("go_asio_ipfs_cat failed to read");
+			C.execute_data_cb(fn, C.IPFS_READ_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		cdata := C.CBytes(bytes)
+		defer C.free(cdata)
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(bytes)), fn_arg)
+	}()
+}
+
+// Returns the file at `cid` positioned at `offset`, or at its end if that's
+// past it, together with its size. Seeking in a UnixFS file only fetches the
+// blocks on the path to `offset`.
+func getFileAt(ctx context.Context, n *Node, cid string, offset uint64) (files.File, int64, C.int) {
+	file, ec := getFile(ctx, n, cid)
+
+	if ec != C.IPFS_SUCCESS {
+		return nil, 0, ec
+	}
+
+	size, err := file.Size()
+
+	if err != nil {
+		fmt.Println("go_asio_ipfs_cat failed to get file size");
+		file.Close()
+		return nil, 0, C.IPFS_READ_FAILED
+	}
+
+	// Clamped before the conversion, offsets past 2^63 must not wrap
+	// around to negative ones.
+	if offset > uint64(size) {
+		offset = uint64(size)
+	}
+
+	if offset > 0 {
+		_, err = file.Seek(int64(offset), io.SeekStart)
+
+		if err != nil {
+			fmt.Println("go_asio_ipfs_cat failed to seek");
+			file.Close()
+			return nil, 0, C.IPFS_READ_FAILED
+		}
+	}
+
+	return file, size, C.IPFS_SUCCESS
+}
+
+// Returns at most `length` bytes starting at `offset`, fetching only the
+// blocks that cover that range.
+//export go_asio_ipfs_cat_range
+func go_asio_ipfs_cat_range(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, cid_size C.size_t, offset C.uint64_t, length C.uint64_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	cid := C.GoStringN(c_cid, C.int(cid_size))
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_cat_range start");
+			defer fmt.Println("go_asio_ipfs_cat_range end");
+		}
+
+		file, size, ec := getFileAt(cancel_ctx, n, cid, uint64(offset))
+
+		if ec != C.IPFS_SUCCESS {
+			C.execute_data_cb(fn, ec, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		defer file.Close()
+
+		available := uint64(0)
+		if uint64(offset) < uint64(size) { available = uint64(size) - uint64(offset) }
+
+		l := uint64(length)
+		if l > available { l = available }
+
+		if l == 0 {
+			C.execute_data_cb(fn, C.IPFS_SUCCESS, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		bytes := make([]byte, l)
+		_, err := io.ReadFull(file, bytes)
+
+		if err != nil {
+			fmt.Println("go_asio_ipfs_cat_range failed to read");
+			C.execute_data_cb(fn, C.IPFS_READ_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, unsafe.Pointer(&bytes[0]), C.size_t(l), fn_arg)
+	}()
+}
+
+// Set `length` to the maximum value of uint64_t to read until the end.
+//export go_asio_ipfs_reader_allocate
+func go_asio_ipfs_reader_allocate(handle uint64, c_cid *C.char, cid_size C.size_t, offset C.uint64_t, length C.uint64_t) uint64 {
+	n, _ := getNode(handle)
+
+	var r reader
+	r.cid = C.GoStringN(c_cid, C.int(cid_size))
+	r.offset = uint64(offset)
+	r.remaining = uint64(length)
+	r.ctx, r.cancel = context.WithCancel(n.ctx)
+
+	return n.addReader(&r)
+}
+
+//export go_asio_ipfs_reader_free
+func go_asio_ipfs_reader_free(handle uint64, reader_id uint64) {
+	n, ok := getNode(handle)
+	if !ok { return }
+
+	r, ok := n.removeReader(reader_id)
+	if !ok { return }
+
+	r.cancel()
+
+	// A read may still be in progress, don't block the C thread on it.
+	go func() {
+		r.mutex.Lock()
+		defer r.mutex.Unlock()
+
+		if r.file != nil {
+			r.file.Close()
+			r.file = nil
+		}
+	}()
+}
+
+// Reads at most `size` bytes from the reader. Zero bytes with IPFS_SUCCESS
+// signals the end of the file. Cancelling a read cancels the whole reader.
+//export go_asio_ipfs_reader_read
+func go_asio_ipfs_reader_read(handle uint64, cancel_signal C.uint64_t, reader_id uint64, size C.size_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	r, ok := n.getReader(reader_id)
+
+	if !ok {
+		C.execute_data_cb(fn, C.IPFS_READ_FAILED, nil, C.size_t(0), fn_arg)
+		return
+	}
+
+	n.setCancel(cancel_signal, r.cancel)
+
+	max := int(size)
+	if max > maxReadChunk { max = maxReadChunk }
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_reader_read start");
+			defer fmt.Println("go_asio_ipfs_reader_read end");
+		}
+
+		r.mutex.Lock()
+		defer r.mutex.Unlock()
+
+		if r.ctx.Err() != nil {
+			C.execute_data_cb(fn, C.IPFS_READ_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		if r.file == nil {
+			file, _, ec := getFileAt(r.ctx, n, r.cid, r.offset)
+
+			if ec != C.IPFS_SUCCESS {
+				C.execute_data_cb(fn, ec, nil, C.size_t(0), fn_arg)
+				return
+			}
+
+			r.file = file
+		}
+
+		if uint64(max) > r.remaining {
+			max = int(r.remaining)
+		}
+
+		if cap(r.buf) < max {
+			r.buf = make([]byte, max)
+		}
+
+		buf := r.buf[:max]
+
+		var l int
+		var err error
+
+		for l == 0 && err == nil && max > 0 {
+			l, err = r.file.Read(buf)
+		}
+
+		if err != nil && err != io.EOF {
+			fmt.Println("go_asio_ipfs_reader_read failed to read");
+			C.execute_data_cb(fn, C.IPFS_READ_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		r.remaining -= uint64(l)
+
+		if l == 0 {
+			C.execute_data_cb(fn, C.IPFS_SUCCESS, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		// The buffer holds no Go pointers and C copies out of it before
+		// returning, so there is no need for a C.CBytes copy here.
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, unsafe.Pointer(&buf[0]), C.size_t(l), fn_arg)
+	}()
+}
+
+// Newline separated, each address ends in /ipfs/<id>.
+// IMPORTANT: The returned value needs to be explicitly `free`d.
+//export go_asio_ipfs_swarm_addrs
+func go_asio_ipfs_swarm_addrs(handle uint64) *C.char {
+	n, _ := getNode(handle)
+
+	var addrs []string
+
+	if n.node.IsOnline {
+		suffix := "/ipfs/" + n.node.Identity.Pretty()
+
+		for _, addr := range n.node.PeerHost.Addrs() {
+			addrs = append(addrs, addr.String() + suffix)
+		}
+	}
+
+	return C.CString(strings.Join(addrs, "\n"))
+}
+
+//export go_asio_ipfs_swarm_connect
+func go_asio_ipfs_swarm_connect(handle uint64, cancel_signal C.uint64_t, c_addr *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	addr := C.GoString(c_addr)
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_swarm_connect start");
+			defer fmt.Println("go_asio_ipfs_swarm_connect end");
+		}
+
+		pi, err := parsePeerAddr(addr)
+
+		if err != nil {
+			fmt.Printf("go_asio_ipfs_swarm_connect invalid address %q %q\n", addr, err)
+			C.execute_void_cb(fn, C.IPFS_CONNECT_FAILED, fn_arg)
+			return
+		}
+
+		err = n.api.Swarm().Connect(cancel_ctx, pi)
+
+		if err != nil {
+			fmt.Printf("go_asio_ipfs_swarm_connect failed to connect to %q %q\n", addr, err)
+			C.execute_void_cb(fn, C.IPFS_CONNECT_FAILED, fn_arg)
+			return
+		}
+
+		C.execute_void_cb(fn, C.IPFS_SUCCESS, fn_arg)
+	}()
+}
+
+//export go_asio_ipfs_pin
+func go_asio_ipfs_pin(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, cid_size C.size_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	cid := C.GoStringN(c_cid, C.int(cid_size))
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_pin start");
+			defer fmt.Println("go_asio_ipfs_pin end");
+		}
+
+		path, err := coreiface.ParsePath(cid)
+
+		if err != nil {
+			fmt.Printf("go_asio_ipfs_pin failed to pin %q %q\n", cid, err)
+			C.execute_void_cb(fn, C.IPFS_PIN_FAILED, fn_arg)
+			return
+		}
+
+		n.ensureBootstrapped()
+
+		err = n.api.Pin().Add(cancel_ctx, path)
+
+		if err != nil {
+			fmt.Printf("go_asio_ipfs_pin failed to pin %q %q\n", cid, err)
+			C.execute_void_cb(fn, C.IPFS_PIN_FAILED, fn_arg)
+			return
+		}
+
+		C.execute_void_cb(fn, C.IPFS_SUCCESS, fn_arg)
+	}()
+}
+
+//export go_asio_ipfs_unpin
+func go_asio_ipfs_unpin(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, cid_size C.size_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	cid := C.GoStringN(c_cid, C.int(cid_size))
+
+	cancel_ctx := withCancel(n, cancel_signal)
+
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_unpin start");
+			defer fmt.Println("go_asio_ipfs_unpin end");
+		}
+
+		path, err := coreiface.ParsePath(cid)
+
+		if err != nil {
+			fmt.Printf("go_asio_ipfs_pin failed to unpin %q %q\n", cid, err)
+			C.execute_void_cb(fn, C.IPFS_PIN_FAILED, fn_arg)
+			return
+		}
+
+		err = n.api.Pin().Rm(cancel_ctx, path)
+
+		if err != nil {
+			fmt.Printf("go_asio_ipfs_unpin failed to unpin %q %q\n", cid, err);
+			C.execute_void_cb(fn, C.IPFS_UNPIN_FAILED, fn_arg)
+			return
+		}
+
+		C.execute_void_cb(fn, C.IPFS_SUCCESS, fn_arg)
+	}()
+}
+
+// What a batched pin has done so far, updated atomically.
+type pinProgress struct {
+	blocks uint64
+	bytes  uint64
+	done   uint64
+}
+
+// Fetches every block of the DAG under `root` not yet seen by another walk
+// of the same batch, one level of the DAG at a time.
+func fetchDag(ctx context.Context, dag ipld.DAGService, root ipld.Node, seen *sync.Map, progress *pinProgress) error {
+	var next []cid.Cid
+
+	visit := func(nd ipld.Node) {
+		atomic.AddUint64(&progress.blocks, 1)
+		atomic.AddUint64(&progress.bytes, uint64(len(nd.RawData())))
+
+		for _, l := range nd.Links() {
+			if _, loaded := seen.LoadOrStore(l.Cid.KeyString(), struct{}{}); !loaded {
+				next = append(next, l.Cid)
+			}
+		}
+	}
+
+	seen.Store(root.Cid().KeyString(), struct{}{})
+	visit(root)
+
+	for len(next) > 0 {
+		level := next
+		next = nil
+
+		for opt := range dag.GetMany(ctx, level) {
+			if opt.Err != nil {
+				return opt.Err
+			}
+			visit(opt.Node)
+		}
+	}
+
+	return ctx.Err()
+}
+
+// Fetches the DAGs of `cids`, at most `parallelism` of them at a time, and
+// once all of them are local pins them recursively with a single flush.
+// Either all of them get pinned or none.
+func pinMany(ctx context.Context, n *Node, cids []string, parallelism int, progress *pinProgress) error {
+	n.ensureBootstrapped()
+
+	ctx, cancel := context.WithCancel(ctx)
+	defer cancel()
+
+	roots := make([]ipld.Node, len(cids))
+	seen := new(sync.Map)
+	sem := make(chan struct{}, parallelism)
+
+	var wg sync.WaitGroup
+	var mutex sync.Mutex
+	var first_err error
+
+	for i, c := range cids {
+		sem <- struct{}{}
+		wg.Add(1)
+
+		go func(i int, c string) {
+			defer func() { <-sem; wg.Done() }()
+
+			err := func() error {
+				p, err := coreiface.ParsePath(c)
+				if err != nil {
+					return err
+				}
+
+				nd, err := n.api.ResolveNode(ctx, p)
+				if err != nil {
+					return err
+				}
+
+				if err := fetchDag(ctx, n.node.DAG, nd, seen, progress); err != nil {
+					return err
+				}
+
+				roots[i] = nd
+				atomic.AddUint64(&progress.done, 1)
+				return nil
+			}()
+
+			if err != nil {
+				mutex.Lock()
+				if first_err == nil {
+					first_err = err
+					cancel()
+				}
+				mutex.Unlock()
+			}
+		}(i, c)
+	}
+
+	wg.Wait()
+
+	if first_err != nil {
+		return first_err
+	}
+
+	defer n.node.Blockstore.PinLock().Unlock()
+
+	// Roots pinned here which weren't pinned before, to be unpinned again
+	// if pinning any of the others fails. Otherwise the next flush, from
+	// whichever caller, would persist them.
+	var added []cid.Cid
+	added_set := make(map[cid.Cid]bool)
+
+	for _, nd := range roots {
+		c := nd.Cid()
+
+		_, pinned, err := n.node.Pinning.IsPinnedWithType(c, pin.Recursive)
+
+		// The DAG is local by now, so this only records the pin.
+		if err == nil {
+			err = n.node.Pinning.Pin(ctx, nd, true)
+		}
+
+		if err != nil {
+			for _, c := range added {
+				if err := n.node.Pinning.Unpin(n.ctx, c, true); err != nil {
+					fmt.Println("pinMany failed to roll back pin of", c, err)
+				}
+			}
+			return err
+		}
+
+		if !pinned && !added_set[c] {
+			added_set[c] = true
+			added = append(added, c)
+		}
 	}
 
-	k := n.PrivateKey
+	return n.node.Pinning.Flush()
+}
 
-	eol := time.Now().Add(duration)
-	err  = n.Namesys.PublishWithEOL(ctx, k, path, eol)
+// Removes the recursive pins of all of `cids` with a single flush. Either
+// all of them get unpinned or none.
+func unpinMany(ctx context.Context, n *Node, cids []string) error {
+	roots := make([]cid.Cid, 0, len(cids))
 
-	if err != nil {
-		fmt.Println("go_asio_ipfs_publish failed");
+	for _, c := range cids {
+		p, err := coreiface.ParsePath(c)
+		if err != nil {
+			return err
+		}
+
+		rp, err := n.api.ResolvePath(ctx, p)
+		if err != nil {
+			return err
+		}
+
+		roots = append(roots, rp.Cid())
+	}
+
+	defer n.node.Blockstore.PinLock().Unlock()
+
+	// Pins removed here, to be put back if removing any of the others
+	// fails. Otherwise the next flush, from whichever caller, would
+	// persist their removal.
+	var removed []cid.Cid
+
+	rollback := func() {
+		for _, c := range removed {
+			n.node.Pinning.PinWithMode(c, pin.Recursive)
+		}
+	}
+
+	for _, c := range roots {
+		if err := n.node.Pinning.Unpin(ctx, c, true); err != nil {
+			rollback()
+			return err
+		}
+
+		removed = append(removed, c)
+	}
+
+	if err := n.node.Pinning.Flush(); err != nil {
+		rollback()
 		return err
 	}
 
 	return nil
 }
 
-//export go_asio_ipfs_publish
-func go_asio_ipfs_publish(handle uint64, cancel_signal C.uint64_t, cid *C.char, seconds C.int64_t, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
-	var n = g_nodes[handle]
+// Newline separated list of CIDs, empty lines are ignored.
+func splitCids(c_cids *C.char) []string {
+	var ret []string
+
+	for _, c := range strings.Split(C.GoString(c_cids), "\n") {
+		if c != "" {
+			ret = append(ret, c)
+		}
+	}
+
+	return ret
+}
+
+// Progress is reported through `progress_fn` (if not nil) periodically. It
+// is called one last time with `last` set before `fn` is called.
+//export go_asio_ipfs_pin_many
+func go_asio_ipfs_pin_many(handle uint64, cancel_signal C.uint64_t, c_cids *C.char, parallelism C.int, progress_fn unsafe.Pointer, progress_arg unsafe.Pointer, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
 
-	id := C.GoString(cid)
+	cids := splitCids(c_cids)
+
+	if parallelism < 1 {
+		parallelism = 1
+	}
 
 	cancel_ctx := withCancel(n, cancel_signal)
 
 	go func() {
 		if debug {
-			fmt.Println("go_asio_ipfs_publish start");
-			defer fmt.Println("go_asio_ipfs_publish end");
+			fmt.Println("go_asio_ipfs_pin_many start");
+			defer fmt.Println("go_asio_ipfs_pin_many end");
 		}
 
-		// https://stackoverflow.com/questions/17573190/how-to-multiply-duration-by-integer
-		err := publish(cancel_ctx, time.Duration(seconds) * time.Second, n.node, id);
+		var progress pinProgress
+
+		report := func(last bool) {
+			if progress_fn == nil {
+				return
+			}
+
+			var c_last C.int
+			if last {
+				c_last = 1
+			}
+
+			C.execute_progress_cb(progress_fn,
+				C.uint64_t(atomic.LoadUint64(&progress.blocks)),
+				C.uint64_t(atomic.LoadUint64(&progress.bytes)),
+				C.uint64_t(atomic.LoadUint64(&progress.done)),
+				c_last, progress_arg)
+		}
+
+		stop := make(chan struct{})
+		stopped := make(chan struct{})
+
+		go func() {
+			defer close(stopped)
+
+			ticker := time.NewTicker(pinProgressInterval)
+			defer ticker.Stop()
+
+			for {
+				select {
+				case <-ticker.C:
+					report(false)
+				case <-stop:
+					return
+				}
+			}
+		}()
+
+		err := pinMany(cancel_ctx, n, cids, int(parallelism), &progress)
+
+		close(stop)
+		<-stopped
+		report(true)
 
 		if err != nil {
-			C.execute_void_cb(fn, C.IPFS_PUBLISH_FAILED, fn_arg)
+			fmt.Printf("go_asio_ipfs_pin_many failed to pin %q\n", err)
+			C.execute_void_cb(fn, C.IPFS_PIN_FAILED, fn_arg)
 			return
 		}
 
@@ -439,168 +2639,456 @@ func go_asio_ipfs_publish(handle uint64, cancel_signal C.uint64_t, cid *C.char,
 	}()
 }
 
-//export go_asio_ipfs_add
-func go_asio_ipfs_add(handle uint64, data unsafe.Pointer, size C.size_t, only_hash bool, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
-	var n = g_nodes[handle]
+//export go_asio_ipfs_unpin_many
+func go_asio_ipfs_unpin_many(handle uint64, cancel_signal C.uint64_t, c_cids *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
 
-	msg := C.GoBytes(data, C.int(size))
+	cids := splitCids(c_cids)
+
+	cancel_ctx := withCancel(n, cancel_signal)
 
 	go func() {
 		if debug {
-			fmt.Println("go_asio_ipfs_add start");
-			defer fmt.Println("go_asio_ipfs_add end");
+			fmt.Println("go_asio_ipfs_unpin_many start");
+			defer fmt.Println("go_asio_ipfs_unpin_many end");
 		}
 
-		p, err := n.api.Unixfs().Add(n.node.Context(), files.NewBytesFile(msg), options.Unixfs.HashOnly(only_hash))
+		err := unpinMany(cancel_ctx, n, cids)
 
 		if err != nil {
-			fmt.Println("Error: failed to insert content ", err)
-			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
-			return;
+			fmt.Printf("go_asio_ipfs_unpin_many failed to unpin %q\n", err)
+			C.execute_void_cb(fn, C.IPFS_UNPIN_FAILED, fn_arg)
+			return
 		}
 
-		cid := p.Root()
+		C.execute_void_cb(fn, C.IPFS_SUCCESS, fn_arg)
+	}()
+}
 
-		if err != nil {
-			fmt.Println("Error: failed to parse IPFS path ", err)
-			C.execute_data_cb(fn, C.IPFS_ADD_FAILED, nil, C.size_t(0), fn_arg)
-			return;
+
+// Walks the DAG under `root` with `parallelism` workers getting one block
+// each at a time, so at most that many blocks are wanted from the network at
+// once. Links are followed depth first, in order, which keeps the queue short
+// and brings in a file roughly from its start.
+func prefetchDag(ctx context.Context, ng ipld.NodeGetter, root cid.Cid, parallelism int, progress *pinProgress) error {
+	ctx, cancel := context.WithCancel(ctx)
+	defer cancel()
+
+	var mutex sync.Mutex
+	cond := sync.NewCond(&mutex)
+
+	queue := []cid.Cid{root}
+	seen := map[string]struct{}{root.KeyString(): {}}
+	// Blocks queued or being fetched.
+	pending := 1
+	var first_err error
+
+	worker := func() {
+		mutex.Lock()
+		defer mutex.Unlock()
+
+		for {
+			for len(queue) == 0 && pending > 0 && first_err == nil {
+				cond.Wait()
+			}
+
+			if pending == 0 || first_err != nil {
+				return
+			}
+
+			c := queue[len(queue)-1]
+			queue = queue[:len(queue)-1]
+
+			mutex.Unlock()
+			nd, err := ng.Get(ctx, c)
+			mutex.Lock()
+
+			pending--
+
+			if err != nil {
+				if first_err == nil {
+					first_err = err
+					cancel()
+				}
+			} else {
+				progress.blocks++
+				progress.bytes += uint64(len(nd.RawData()))
+
+				links := nd.Links()
+
+				for i := len(links) - 1; i >= 0; i-- {
+					k := links[i].Cid.KeyString()
+					if _, ok := seen[k]; !ok {
+						seen[k] = struct{}{}
+						queue = append(queue, links[i].Cid)
+						pending++
+					}
+				}
+			}
+
+			cond.Broadcast()
 		}
+	}
 
-		cidstr := cid.String()
-		cdata := C.CBytes([]byte(cidstr))
-		defer C.free(cdata)
+	var wg sync.WaitGroup
 
-		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(cidstr)), fn_arg)
-	}()
+	for i := 0; i < parallelism; i++ {
+		wg.Add(1)
+		go func() { defer wg.Done(); worker() }()
+	}
+
+	wg.Wait()
+
+	if first_err != nil {
+		return first_err
+	}
+
+	return ctx.Err()
 }
 
-//export go_asio_ipfs_cat
-func go_asio_ipfs_cat(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
-	var n = g_nodes[handle]
+// Fetches the DAG under `c` into the blockstore, in one bitswap session, and
+// optionally pins it once it's all local.
+func prefetch(ctx context.Context, n *Node, c string, parallelism int, do_pin bool, progress *pinProgress) error {
+	n.ensureBootstrapped()
+
+	p, err := coreiface.ParsePath(c)
+	if err != nil {
+		return err
+	}
+
+	rp, err := n.api.ResolvePath(ctx, p)
+	if err != nil {
+		return err
+	}
+
+	ng := dag.NewSession(ctx, n.node.DAG)
+
+	if err := prefetchDag(ctx, ng, rp.Cid(), parallelism, progress); err != nil {
+		return err
+	}
+
+	if !do_pin {
+		return nil
+	}
+
+	nd, err := n.node.DAG.Get(ctx, rp.Cid())
+	if err != nil {
+		return err
+	}
+
+	defer n.node.Blockstore.PinLock().Unlock()
+
+	if err := n.node.Pinning.Pin(ctx, nd, true); err != nil {
+		return err
+	}
+
+	return n.node.Pinning.Flush()
+}
 
-	cid := C.GoString(c_cid)
+// Reports the number of blocks and bytes in the DAG as two uint64_t values.
+//export go_asio_ipfs_prefetch
+func go_asio_ipfs_prefetch(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, cid_size C.size_t, parallelism C.int, do_pin bool, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	cid := C.GoStringN(c_cid, C.int(cid_size))
+
+	if parallelism < 1 {
+		parallelism = 1
+	}
 
 	cancel_ctx := withCancel(n, cancel_signal)
 
 	go func() {
 		if debug {
-			fmt.Println("go_asio_ipfs_cat start");
-			defer fmt.Println("go_asio_ipfs_cat end");
+			fmt.Println("go_asio_ipfs_prefetch start");
+			defer fmt.Println("go_asio_ipfs_prefetch end");
 		}
 
-		path, err := coreiface.ParsePath(cid);
+		var progress pinProgress
+
+		err := prefetch(cancel_ctx, n, cid, int(parallelism), do_pin, &progress)
 
 		if err != nil {
-			fmt.Printf("go_asio_ipfs_cat failed to parse cid %q\n", err);
-			C.execute_data_cb(fn, C.IPFS_CAT_FAILED, nil, C.size_t(0), fn_arg)
+			fmt.Printf("go_asio_ipfs_prefetch failed to fetch %q %q\n", cid, err)
+			C.execute_data_cb(fn, C.IPFS_PREFETCH_FAILED, nil, C.size_t(0), fn_arg)
 			return
 		}
 
-		f, err := n.api.Unixfs().Get(cancel_ctx, path)
+		cdata := C.malloc(2 * 8)
+		defer C.free(cdata)
+
+		out := (*[2]C.uint64_t)(cdata)
+		out[0] = C.uint64_t(progress.blocks)
+		out[1] = C.uint64_t(progress.bytes)
 
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(2 * 8), fn_arg)
+	}()
+}
+
+// Stores `datas` as blocks in a single batch, with the CIDs the CoreAPI's
+// Block().Put would give them for `format`. Going through the block service
+// directly saves Block().Put reading each of them into yet another slice.
+func putBlocks(n *Node, datas [][]byte, format string) ([]string, error) {
+	_, prefix, err := options.BlockPutOptions(options.Block.Format(format))
+	if err != nil {
+		return nil, err
+	}
+
+	blks := make([]blocks.Block, len(datas))
+	cids := make([]string, len(datas))
+
+	for i, d := range datas {
+		c, err := prefix.Sum(d)
 		if err != nil {
-			fmt.Printf("go_asio_ipfs_cat failed to Cat %q\n", err);
-			C.execute_data_cb(fn, C.IPFS_CAT_FAILED, nil, C.size_t(0), fn_arg)
-			return
+			return nil, err
+		}
+
+		b, err := blocks.NewBlockWithCid(d, c)
+		if err != nil {
+			return nil, err
 		}
 
-		var file files.File
+		blks[i] = b
+		cids[i] = c.String()
+	}
 
-		switch f := f.(type) {
-		case files.File:
-			file = f
-		case files.Directory:
-			fmt.Printf("go_asio_ipfs_cat path corresponds to a directory\n");
-			C.execute_data_cb(fn, C.IPFS_CAT_FAILED, nil, C.size_t(0), fn_arg)
-			return
-		default:
-			fmt.Printf("go_asio_ipfs_cat unsupported type\n");
-			C.execute_data_cb(fn, C.IPFS_CAT_FAILED, nil, C.size_t(0), fn_arg)
-			return
+	if err := n.node.Blocks.AddBlocks(blks); err != nil {
+		return nil, err
+	}
+
+	return cids, nil
+}
+
+//export go_asio_ipfs_block_put
+func go_asio_ipfs_block_put(handle uint64, c_datas *unsafe.Pointer, c_sizes *C.size_t, count C.size_t, c_format *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	format := C.GoString(c_format)
+
+	msgs := make([][]byte, int(count))
+
+	if count > 0 {
+		datas := (*[1 << 28]unsafe.Pointer)(unsafe.Pointer(c_datas))[:count:count]
+		sizes := (*[1 << 28]C.size_t)(unsafe.Pointer(c_sizes))[:count:count]
+
+		for i := range msgs {
+			msgs[i] = C.GoBytes(datas[i], C.int(sizes[i]))
 		}
+	}
 
-		var r io.Reader = file
-		bytes, err := ioutil.ReadAll(r)
+	go func() {
+		if debug {
+			fmt.Println("go_asio_ipfs_block_put start");
+			defer fmt.Println("go_asio_ipfs_block_put end");
+		}
+
+		cids, err := putBlocks(n, msgs, format)
 
 		if err != nil {
-			fmt.Println("go_asio_ipfs_cat failed to read");
-			C.execute_data_cb(fn, C.IPFS_READ_FAILED, nil, C.size_t(0), fn_arg)
+			fmt.Println("go_asio_ipfs_block_put failed to put blocks ", err)
+			C.execute_data_cb(fn, C.IPFS_BLOCK_FAILED, nil, C.size_t(0), fn_arg)
 			return
 		}
 
-		cdata := C.CBytes(bytes)
-		defer C.free(cdata)
+		data := []byte(strings.Join(cids, "\n"))
 
-		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(bytes)), fn_arg)
+		if len(data) == 0 {
+			C.execute_data_cb(fn, C.IPFS_SUCCESS, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, unsafe.Pointer(&data[0]), C.size_t(len(data)), fn_arg)
 	}()
 }
 
-//export go_asio_ipfs_pin
-func go_asio_ipfs_pin(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
-	var n = g_nodes[handle]
+// Returns a reader over the data of block `c`, and its size. The CoreAPI
+// hands blocks out as readers over data it already holds in memory.
+func getBlock(ctx context.Context, n *Node, c string) (io.Reader, int, error) {
+	n.ensureBootstrapped()
+
+	p, err := coreiface.ParsePath(c)
+	if err != nil {
+		return nil, 0, err
+	}
+
+	r, err := n.api.Block().Get(ctx, p)
+	if err != nil {
+		return nil, 0, err
+	}
+
+	if l, ok := r.(interface{ Len() int }); ok {
+		return r, l.Len(), nil
+	}
+
+	data, err := ioutil.ReadAll(r)
+	if err != nil {
+		return nil, 0, err
+	}
+
+	return bytes.NewReader(data), len(data), nil
+}
+
+// C memory of `size` bytes at `p` as a slice.
+func cBytes(p unsafe.Pointer, size int) []byte {
+	if size == 0 {
+		return nil
+	}
+	return (*[1 << 30]byte)(p)[:size:size]
+}
+
+// The block is written into `dst` only once `claim_fn` says the operation
+// hasn't been cancelled; from then on the C++ side keeps the buffer from the
+// user until `fn` gets called. The block's size is passed to `fn` as the
+// data size, with no data.
+//export go_asio_ipfs_block_get
+func go_asio_ipfs_block_get(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, cid_size C.size_t, dst unsafe.Pointer, dst_size C.size_t, claim_fn unsafe.Pointer, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
 
-	cid := C.GoString(c_cid)
+	cid := C.GoStringN(c_cid, C.int(cid_size))
 
 	cancel_ctx := withCancel(n, cancel_signal)
 
 	go func() {
 		if debug {
-			fmt.Println("go_asio_ipfs_pin start");
-			defer fmt.Println("go_asio_ipfs_pin end");
+			fmt.Println("go_asio_ipfs_block_get start");
+			defer fmt.Println("go_asio_ipfs_block_get end");
 		}
 
-		path, err := coreiface.ParsePath(cid)
+		r, size, err := getBlock(cancel_ctx, n, cid)
 
 		if err != nil {
-			fmt.Printf("go_asio_ipfs_pin failed to pin %q %q\n", cid, err)
-			C.execute_void_cb(fn, C.IPFS_PIN_FAILED, fn_arg)
+			fmt.Printf("go_asio_ipfs_block_get failed to get %q %q\n", cid, err)
+			C.execute_data_cb(fn, C.IPFS_BLOCK_FAILED, nil, C.size_t(0), fn_arg)
 			return
 		}
 
-		err = n.api.Pin().Add(cancel_ctx, path)
-
-		if err != nil {
-			fmt.Printf("go_asio_ipfs_pin failed to pin %q %q\n", cid, err)
-			C.execute_void_cb(fn, C.IPFS_PIN_FAILED, fn_arg)
+		if C.size_t(size) > dst_size {
+			C.execute_data_cb(fn, C.IPFS_BUFFER_TOO_SMALL, nil, C.size_t(size), fn_arg)
 			return
 		}
 
-		C.execute_void_cb(fn, C.IPFS_SUCCESS, fn_arg)
+		if C.execute_claim_cb(claim_fn, fn_arg) != 0 {
+			if _, err := io.ReadFull(r, cBytes(dst, size)); err != nil {
+				fmt.Printf("go_asio_ipfs_block_get failed to read %q %q\n", cid, err)
+				C.execute_data_cb(fn, C.IPFS_BLOCK_FAILED, nil, C.size_t(0), fn_arg)
+				return
+			}
+		}
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, nil, C.size_t(size), fn_arg)
 	}()
 }
 
-//export go_asio_ipfs_unpin
-func go_asio_ipfs_unpin(handle uint64, cancel_signal C.uint64_t, c_cid *C.char, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
-	var n = g_nodes[handle]
+// Gets all of `cids` through one request to the block service. Duplicates
+// are only asked for once.
+func getBlocks(ctx context.Context, n *Node, cids []string) ([]blocks.Block, error) {
+	n.ensureBootstrapped()
+
+	var keys []cid.Cid
+	index := make(map[string][]int)
+
+	for i, s := range cids {
+		c, err := cid.Decode(s)
+		if err != nil {
+			return nil, err
+		}
+
+		k := c.KeyString()
+
+		if _, ok := index[k]; !ok {
+			keys = append(keys, c)
+		}
+
+		index[k] = append(index[k], i)
+	}
+
+	ret := make([]blocks.Block, len(cids))
+
+	for b := range n.node.Blocks.GetBlocks(ctx, keys) {
+		for _, i := range index[b.Cid().KeyString()] {
+			ret[i] = b
+		}
+	}
+
+	for i, b := range ret {
+		if b == nil {
+			if ctx.Err() != nil {
+				return nil, ctx.Err()
+			}
+			return nil, fmt.Errorf("block %s not found", cids[i])
+		}
+	}
+
+	return ret, nil
+}
+
+// Same as go_asio_ipfs_block_get but for newline separated `c_cids`, each
+// written into its own buffer. `fn` gets the sizes as uint64_t values.
+//export go_asio_ipfs_block_get_many
+func go_asio_ipfs_block_get_many(handle uint64, cancel_signal C.uint64_t, c_cids *C.char, c_dsts *unsafe.Pointer, c_dst_sizes *C.size_t, count C.size_t, claim_fn unsafe.Pointer, fn unsafe.Pointer, fn_arg unsafe.Pointer) {
+	n, _ := getNode(handle)
+
+	cids := splitCids(c_cids)
+
+	// The arrays themselves only live until this function returns, the
+	// buffers they point to until `fn` gets called.
+	dsts := make([]unsafe.Pointer, count)
+	dst_sizes := make([]C.size_t, count)
 
-	cid := C.GoString(c_cid)
+	if count > 0 {
+		copy(dsts, (*[1 << 28]unsafe.Pointer)(unsafe.Pointer(c_dsts))[:count:count])
+		copy(dst_sizes, (*[1 << 28]C.size_t)(unsafe.Pointer(c_dst_sizes))[:count:count])
+	}
 
 	cancel_ctx := withCancel(n, cancel_signal)
 
 	go func() {
 		if debug {
-			fmt.Println("go_asio_ipfs_unpin start");
-			defer fmt.Println("go_asio_ipfs_unpin end");
+			fmt.Println("go_asio_ipfs_block_get_many start");
+			defer fmt.Println("go_asio_ipfs_block_get_many end");
 		}
 
-		path, err := coreiface.ParsePath(cid)
+		if len(cids) != len(dsts) {
+			fmt.Println("go_asio_ipfs_block_get_many got", len(cids), "CIDs for", len(dsts), "buffers")
+			C.execute_data_cb(fn, C.IPFS_BLOCK_FAILED, nil, C.size_t(0), fn_arg)
+			return
+		}
+
+		blks, err := getBlocks(cancel_ctx, n, cids)
 
 		if err != nil {
-			fmt.Printf("go_asio_ipfs_pin failed to unpin %q %q\n", cid, err)
-			C.execute_void_cb(fn, C.IPFS_PIN_FAILED, fn_arg)
+			fmt.Println("go_asio_ipfs_block_get_many failed to get blocks ", err)
+			C.execute_data_cb(fn, C.IPFS_BLOCK_FAILED, nil, C.size_t(0), fn_arg)
 			return
 		}
 
-		err = n.api.Pin().Rm(cancel_ctx, path)
+		for i, b := range blks {
+			if C.size_t(len(b.RawData())) > dst_sizes[i] {
+				C.execute_data_cb(fn, C.IPFS_BUFFER_TOO_SMALL, nil, C.size_t(0), fn_arg)
+				return
+			}
+		}
 
-		if err != nil {
-			fmt.Printf("go_asio_ipfs_unpin failed to unpin %q %q\n", cid, err);
-			C.execute_void_cb(fn, C.IPFS_UNPIN_FAILED, fn_arg)
+		if len(blks) == 0 {
+			C.execute_data_cb(fn, C.IPFS_SUCCESS, nil, C.size_t(0), fn_arg)
 			return
 		}
 
-		C.execute_void_cb(fn, C.IPFS_SUCCESS, fn_arg)
+		cdata := C.malloc(C.size_t(len(blks) * 8))
+		defer C.free(cdata)
+
+		out := (*[1 << 28]C.uint64_t)(cdata)[:len(blks):len(blks)]
+		claimed := C.execute_claim_cb(claim_fn, fn_arg) != 0
+
+		for i, b := range blks {
+			data := b.RawData()
+			out[i] = C.uint64_t(len(data))
+
+			if claimed {
+				copy(cBytes(dsts[i], len(data)), data)
+			}
+		}
+
+		C.execute_data_cb(fn, C.IPFS_SUCCESS, cdata, C.size_t(len(blks) * 8), fn_arg)
 	}()
 }
-
@@ -1,333 +1,2140 @@
 #include <ipfs_bindings.h>
 #include <asio_ipfs/error.h>
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <experimental/tuple>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/version.hpp>
+#if BOOST_VERSION >= 106600
+#include <boost/asio/post.hpp>
+#endif
 #include <boost/intrusive/list.hpp>
+#include <boost/intrusive/set.hpp>
 #include <boost/optional.hpp>
+#include <limits>
+#include <mutex>
+#include <numeric>
 #include <sstream>
+#include <thread>
 
 #include <asio_ipfs.h>
 
+#include "content_cache.h"
+#include "op_stats.h"
+
 using namespace asio_ipfs;
 using namespace std;
 namespace asio = boost::asio;
 namespace sys  = boost::system;
 namespace intr = boost::intrusive;
 
+template<class... As> using Callback = detail::callback<As...>;
+
 template<class F> struct Defer { F f; ~Defer() { f(); } };
 template<class F> Defer<F> defer(F&& f) { return Defer<F>{forward<F>(f)}; }
 
-struct HandleBase : public intr::list_base_hook
-                            <intr::link_mode<intr::auto_unlink>> {
-    virtual void cancel() = 0;
-    virtual ~HandleBase() { }
-};
+// Same as `ios.post(f)`, but `f` may be move-only, as Callbacks are.
+template<class F>
+static void post_handler(asio::io_service& ios, F f)
+{
+#if BOOST_VERSION >= 106600
+    asio::post(ios, move(f));
+#else
+    auto f_ = make_shared<F>(move(f));
+    ios.post([f_] { (*f_)(); });
+#endif
+}
+
+struct HandleBase : public intr::list_base_hook
+                            <intr::link_mode<intr::safe_link>> {
+    // Set, under the registry lock, by whoever gets to finish the handle:
+    // either its completion or its cancellation.
+    bool finished = false;
+    atomic<unsigned> job_count{1};
+
+    // Called once the handle has been claimed for cancellation.
+    virtual void abort() = 0;
+    virtual ~HandleBase() { }
+};
+
+/*
+ * The set of pending handles of a node, so that they can be cancelled when
+ * the node is destroyed. Operations may start, complete and get cancelled
+ * on any thread, so the set is split into independently locked shards.
+ */
+class HandleRegistry {
+public:
+    void insert(HandleBase& h) {
+        auto& s = shard(h);
+        lock_guard<std::mutex> lock(s.mutex);
+        s.list.push_back(h);
+    }
+
+    // Exactly one `claim` or `claim_for_abort` succeeds for each handle.
+    bool claim(HandleBase& h) {
+        auto& s = shard(h);
+        lock_guard<std::mutex> lock(s.mutex);
+        return claim(s, h);
+    }
+
+    // Same as above, but also takes a reference to the handle for the
+    // aborted completion, before a concurrent `complete` can release it.
+    bool claim_for_abort(HandleBase& h) {
+        auto& s = shard(h);
+        lock_guard<std::mutex> lock(s.mutex);
+        if (!claim(s, h)) return false;
+        ++h.job_count;
+        return true;
+    }
+
+    void abort_all() {
+        for (auto& s : _shards) {
+            while (true) {
+                HandleBase* h;
+                {
+                    lock_guard<std::mutex> lock(s.mutex);
+                    if (s.list.empty()) break;
+                    h = &s.list.front();
+                    claim(s, *h);
+                    ++h->job_count;
+                }
+                h->abort();
+            }
+        }
+    }
+
+private:
+    static const size_t shard_count = 16;
+
+    struct Shard {
+        std::mutex mutex;
+        intr::list<HandleBase, intr::constant_time_size<false>> list;
+    };
+
+    Shard& shard(HandleBase& h) {
+        return _shards[(reinterpret_cast<uintptr_t>(&h) / 64) % shard_count];
+    }
+
+    static bool claim(Shard& s, HandleBase& h) {
+        if (h.finished) return false;
+        h.finished = true;
+        s.list.erase(s.list.iterator_to(h));
+        return true;
+    }
+
+private:
+    Shard _shards[shard_count];
+};
+
+struct Completion {
+    Completion* next = nullptr;
+    virtual void complete() = 0;
+
+protected:
+    ~Completion() { }
+};
+
+/*
+ * Lock-free multi-producer queue of completed operations. Go threads push,
+ * and whichever push finds the queue disarmed has to schedule a single
+ * `drain` which then runs every completion pending at that point in one go.
+ * Under load this replaces one `post` (and one io_service lock and wakeup)
+ * per operation with one per batch.
+ */
+class CompletionQueue {
+public:
+    // May be called from any thread. Returns true if the caller needs to
+    // schedule a `drain`.
+    bool push(Completion* c) {
+        c->next = _head.load(memory_order_relaxed);
+        while (!_head.compare_exchange_weak(c->next, c)) {}
+
+        _completions.fetch_add(1, memory_order_relaxed);
+
+        return !_armed.exchange(true);
+    }
+
+    void drain() {
+        // Disarm before taking the list: a push which still sees the queue
+        // armed is then guaranteed to be in the list taken below.
+        _armed.store(false);
+        Completion* c = _head.exchange(nullptr);
+
+        _wakeups.fetch_add(1, memory_order_relaxed);
+
+        // The list is in LIFO order, restore the order of completion.
+        Completion* fifo = nullptr;
+        while (c) {
+            auto next = c->next;
+            c->next = fifo;
+            fifo = c;
+            c = next;
+        }
+
+        while (fifo) {
+            auto next = fifo->next;
+            fifo->complete();
+            fifo = next;
+        }
+    }
+
+    node::completion_stats stats() const {
+        node::completion_stats ret;
+        ret.completions = _completions.load(memory_order_relaxed);
+        ret.wakeups     = _wakeups.load(memory_order_relaxed);
+        return ret;
+    }
+
+private:
+    atomic<Completion*> _head{nullptr};
+    atomic<bool> _armed{false};
+    atomic<uint64_t> _completions{0};
+    atomic<uint64_t> _wakeups{0};
+};
+
+/*
+ * Recycles the memory of Handles and Continuations. There's only a handful
+ * of their types, so a free list per 64 byte size class is enough for a
+ * steady stream of operations to not allocate at all.
+ */
+class HandlePool {
+public:
+    HandlePool() = default;
+    HandlePool(const HandlePool&) = delete;
+    HandlePool& operator=(const HandlePool&) = delete;
+
+    void* allocate(size_t size) {
+        size_t c = size_class(size);
+
+        if (c >= class_count) return ::operator new(size);
+
+        {
+            lock_guard<mutex> lock(_mutex);
+
+            if (auto b = _free[c]) {
+                _free[c] = b->next;
+                --_cached[c];
+                return b;
+            }
+        }
+
+        return ::operator new((c + 1) * granularity);
+    }
+
+    void deallocate(void* p, size_t size) {
+        size_t c = size_class(size);
+
+        if (c < class_count) {
+            lock_guard<mutex> lock(_mutex);
+
+            if (_cached[c] < max_cached) {
+                auto b = static_cast<Block*>(p);
+                b->next = _free[c];
+                _free[c] = b;
+                ++_cached[c];
+                return;
+            }
+        }
+
+        ::operator delete(p);
+    }
+
+    ~HandlePool() {
+        for (auto b : _free) {
+            while (b) {
+                auto next = b->next;
+                ::operator delete(b);
+                b = next;
+            }
+        }
+    }
+
+private:
+    static const size_t granularity = 64;
+    static const size_t class_count = 16;
+    static const size_t max_cached  = 1024;
+
+    static size_t size_class(size_t size) {
+        return (size - 1) / granularity;
+    }
+
+    struct Block { Block* next; };
+
+    mutex _mutex;
+    Block* _free[class_count] = {};
+    size_t _cached[class_count] = {};
+};
+
+/*
+ * The part of a node its handles need. Go may complete an operation after
+ * the node is gone, so this lives until the last handle is released.
+ */
+struct HandleContext : public enable_shared_from_this<HandleContext> {
+    asio::io_service& ios;
+    uint64_t ipfs_handle;
+    HandleRegistry registry;
+    CompletionQueue completions;
+    HandlePool pool;
+    detail::op_recorder stats;
+
+    HandleContext(asio::io_service& ios, uint64_t ipfs_handle)
+        : ios(ios)
+        , ipfs_handle(ipfs_handle)
+    {}
+
+    // May be called from any thread.
+    void complete(Completion* c) {
+        // A drain already running may complete `c` as soon as it's pushed,
+        // and if that was the last work the io_service could be gone
+        // before the post below.
+        asio::io_service::work work(ios);
+
+        if (completions.push(c)) {
+            ios.post([self = shared_from_this()] { self->completions.drain(); });
+        }
+    }
+};
+
+/*
+ * The library's own continuations of an operation: a Callback calling `f`,
+ * with its memory coming from the handle pool.
+ */
+template<class F, class... As>
+struct Continuation final : public detail::op<As...> {
+    shared_ptr<HandleContext> ctx;
+    F f;
+
+    Continuation(shared_ptr<HandleContext> ctx, F f)
+        : ctx(move(ctx)), f(move(f)) {}
+
+    void complete(sys::error_code ec, As... as) override {
+        F f_ = move(f);
+        free();
+        f_(ec, move(as)...);
+    }
+
+    void destroy() override { free(); }
+
+    void free() {
+        auto c = move(ctx);
+        this->~Continuation();
+        c->pool.deallocate(this, sizeof(Continuation));
+    }
+};
+
+template<class... As, class F>
+static Callback<As...> continuation(const shared_ptr<HandleContext>& ctx, F f)
+{
+    using C = Continuation<F, As...>;
+    void* mem = ctx->pool.allocate(sizeof(C));
+    return Callback<As...>(new (mem) C(ctx, move(f)));
+}
+
+using Clock = chrono::steady_clock;
+
+/*
+ * Coalesces concurrent operations on the same key (a CID or an IPNS name):
+ * the first caller starts the IPFS operation and later ones only wait for
+ * its result. Cancelling a waiter, or its deadline passing, completes just
+ * that waiter; the operation itself runs without a deadline and is
+ * cancelled once it has no waiters left.
+ */
+class SingleFlight : public enable_shared_from_this<SingleFlight> {
+public:
+    using Callback = ::Callback<string>;
+
+    explicit SingleFlight(shared_ptr<HandleContext> handles)
+        : _handles(move(handles))
+    {}
+
+    ~SingleFlight() {
+        // Unlinks those in flight before they are destroyed.
+        _flights.clear();
+    }
+
+    // `start(Callback)` is only called if there is no operation on `key` in
+    // flight yet. It must start one, with no deadline, and return its
+    // cancel signal id.
+    template<class Start>
+    void join( boost::string_view key
+             , Clock::time_point deadline
+             , function<void()>* cancel
+             , Callback cb
+             , Start start)
+    {
+        lock_guard<mutex> lock(_mutex);
+
+        Flight* flight;
+        auto i = _flights.find(key, KeyLess());
+        bool leader = i == _flights.end();
+
+        if (leader) {
+            flight = new_flight();
+            flight->key.assign(key.data(), key.size());
+            _flights.insert(*flight);
+        }
+        else {
+            flight = &*i;
+        }
+
+        uint64_t waiter_id = _next_waiter_id++;
+        flight->waiters.push_back(Waiter{waiter_id, move(cb), nullptr});
+
+        // Left as it is once the waiter completes, `leave` then does nothing.
+        if (cancel) {
+            *cancel = [self = shared_from_this(), flight, waiter_id] {
+                self->leave(flight, waiter_id, asio::error::operation_aborted);
+            };
+        }
+
+        if (deadline != Clock::time_point::max()) {
+            auto timer = make_shared<asio::steady_timer>(_handles->ios, deadline);
+            flight->waiters.back().timer = timer;
+
+            timer->async_wait(
+                [self = shared_from_this(), flight, waiter_id]
+                (sys::error_code ec) {
+                    if (ec) return;
+                    self->leave(flight, waiter_id, asio::error::timed_out);
+                });
+        }
+
+        if (!leader) return;
+
+        // The result is handed over through the completion queue, so this
+        // never completes while we hold the lock.
+        flight->cancel_signal_id = start(continuation<string>(_handles,
+            [self = shared_from_this(), flight]
+            (sys::error_code ec, string data) {
+                self->finish(flight, ec, move(data));
+            }));
+    }
+
+private:
+    struct Waiter {
+        // Unique within the SingleFlight, so that a cancel function or timer
+        // outliving its waiter finds nothing once the flight is reused.
+        uint64_t id;
+        Callback cb;
+        // Only if the waiter has a deadline.
+        shared_ptr<asio::steady_timer> timer;
+    };
+
+    /*
+     * Flights are reused once their operation finishes, together with the
+     * memory of their key and waiter list, so that a steady stream of
+     * operations on a few keys allocates nothing here.
+     */
+    struct Flight : public intr::set_base_hook<> {
+        string key;
+        uint64_t cancel_signal_id = 0;
+        vector<Waiter> waiters;
+
+        friend bool operator<(const Flight& a, const Flight& b) {
+            return a.key < b.key;
+        }
+    };
+
+    struct KeyLess {
+        bool operator()(boost::string_view k, const Flight& f) const {
+            return k < boost::string_view(f.key);
+        }
+        bool operator()(const Flight& f, boost::string_view k) const {
+            return boost::string_view(f.key) < k;
+        }
+    };
+
+    Flight* new_flight() {
+        if (_free.empty()) {
+            _storage.emplace_back();
+            return &_storage.back();
+        }
+
+        Flight* f = _free.back();
+        _free.pop_back();
+        return f;
+    }
+
+    // Once no longer in flight, later joins start a new operation.
+    void forget(Flight* flight) {
+        if (flight->is_linked()) _flights.erase(_flights.iterator_to(*flight));
+    }
+
+    void finish(Flight* flight, sys::error_code ec, string data)
+    {
+        vector<Waiter> waiters;
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            forget(flight);
+            waiters.swap(flight->waiters);
+        }
+
+        for (size_t i = 0; i < waiters.size(); ++i) {
+            auto& w = waiters[i];
+            if (w.timer) w.timer->cancel();
+            w.cb(ec, i + 1 == waiters.size() ? move(data) : data);
+        }
+
+        waiters.clear();
+
+        lock_guard<mutex> lock(_mutex);
+        flight->waiters.swap(waiters);
+        _free.push_back(flight);
+    }
+
+    // Completes a single waiter with `ec`, either from its cancel function
+    // or from its deadline timer.
+    void leave(Flight* flight, uint64_t waiter_id, sys::error_code ec)
+    {
+        Callback cb;
+        shared_ptr<asio::steady_timer> timer;
+
+        {
+            lock_guard<mutex> lock(_mutex);
+
+            auto& ws = flight->waiters;
+            auto i = find_if(ws.begin(), ws.end(), [&] (const Waiter& w) {
+                    return w.id == waiter_id;
+                });
+
+            if (i == ws.end()) return;
+
+            cb = move(i->cb);
+            timer = move(i->timer);
+            ws.erase(i);
+
+            if (ws.empty()) {
+                forget(flight);
+                go_asio_ipfs_cancel(_handles->ipfs_handle, flight->cancel_signal_id);
+            }
+        }
+
+        if (timer) timer->cancel();
+
+        post_handler(_handles->ios, [cb = move(cb), ec] () mutable { cb(ec, string()); });
+    }
+
+private:
+    shared_ptr<HandleContext> _handles;
+    mutex _mutex;
+    intr::set<Flight> _flights;
+    // Flights live as long as the SingleFlight does, cancel functions and
+    // timers of their waiters may refer to them after they finish.
+    deque<Flight> _storage;
+    vector<Flight*> _free;
+    uint64_t _next_waiter_id = 0;
+};
+
+static void record(node::latency_histogram& h, Clock::duration d)
+{
+    auto us = chrono::duration_cast<chrono::microseconds>(d);
+    ++h.buckets[node::latency_histogram::bucket_index(us)];
+    ++h.count;
+    h.sum += us;
+}
+
+/*
+ * Limits how many operations of each priority class run at once. The rest
+ * wait in a FIFO queue of their class, and once that is full further ones
+ * are turned away with `error::overloaded`. Interactive and background
+ * operations never wait for each other.
+ */
+class Admission : public enable_shared_from_this<Admission> {
+public:
+    using Cancel = function<void()>;
+    // Starts the operation, which then has to `release` its slot once done.
+    using Start = function<void(Cancel*)>;
+    using Fail = function<void(sys::error_code)>;
+
+    Admission( asio::io_service& ios
+             , unsigned max_interactive
+             , unsigned max_background
+             , size_t max_queued)
+        : _ios(ios)
+        , _max_queued(max_queued)
+    {
+        _classes[0].limit = max_interactive;
+        _classes[1].limit = max_background;
+    }
+
+    bool limited(node::priority_class p) const {
+        return get(p).limit != 0;
+    }
+
+    void submit( node::priority_class p
+               , Clock::time_point deadline
+               , Cancel* cancel
+               , Start start
+               , Fail fail)
+    {
+        unique_lock<std::mutex> lock(_mutex);
+        auto& c = get(p);
+
+        if (_closed) {
+            lock.unlock();
+            if (cancel) *cancel = []{};
+            post(move(fail), asio::error::operation_aborted);
+            return;
+        }
+
+        if (c.running < c.limit) {
+            ++c.running;
+            ++c.admitted;
+            record(c.wait, Clock::duration::zero());
+            lock.unlock();
+            start(cancel);
+            return;
+        }
+
+        if (c.queue.size() >= _max_queued) {
+            ++c.rejected;
+            lock.unlock();
+            if (cancel) *cancel = []{};
+            post(move(fail), error::overloaded);
+            return;
+        }
+
+        auto ticket = make_shared<Ticket>();
+
+        // Set before the operation is queued, after that it may complete
+        // at any time.
+        if (cancel) {
+            *cancel = [self = shared_from_this(), p, ticket] {
+                self->remove(p, ticket, asio::error::operation_aborted);
+            };
+        }
+
+        if (deadline != Clock::time_point::max()) {
+            ticket->timer = make_unique<asio::steady_timer>(_ios, deadline);
+            ticket->timer->async_wait(
+                [self = shared_from_this(), p, ticket] (sys::error_code ec) {
+                    if (ec) return;
+                    self->remove(p, ticket, asio::error::timed_out);
+                });
+        }
+
+        c.queue.push_back(Pending{ ticket, Clock::now(), deadline
+                                 , move(start), move(fail) });
+    }
+
+    // Called once an admitted operation completes, starts the next one.
+    void release(node::priority_class p) {
+        while (true) {
+            Pending next;
+
+            {
+                lock_guard<std::mutex> lock(_mutex);
+                auto& c = get(p);
+
+                if (c.queue.empty() || _closed) {
+                    --c.running;
+                    return;
+                }
+
+                next = move(c.queue.front());
+                c.queue.pop_front();
+            }
+
+            auto& t = *next.ticket;
+            lock_guard<std::mutex> ticket_lock(t.mutex);
+
+            // Cancelled or expired right as we took it off the queue.
+            if (t.state == Ticket::removed) {
+                post(move(next.fail), t.error);
+                continue;
+            }
+
+            auto now = Clock::now();
+
+            {
+                lock_guard<std::mutex> lock(_mutex);
+                auto& c = get(p);
+
+                if (now >= next.deadline) {
+                    ++c.expired;
+                } else {
+                    ++c.admitted;
+                    record(c.wait, now - next.enqueued);
+                }
+            }
+
+            if (t.timer) t.timer->cancel();
+
+            if (now >= next.deadline) {
+                t.state = Ticket::removed;
+                post(move(next.fail), asio::error::timed_out);
+                continue;
+            }
+
+            t.state = Ticket::started;
+            next.start(&t.cancel);
+            return;
+        }
+    }
+
+    // Fails all queued operations, nothing gets started after this.
+    void abort_all() {
+        vector<Pending> pending;
+
+        {
+            lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+
+            for (auto& c : _classes) {
+                for (auto& e : c.queue) pending.push_back(move(e));
+                c.queue.clear();
+            }
+        }
+
+        for (auto& e : pending) {
+            lock_guard<std::mutex> ticket_lock(e.ticket->mutex);
+            e.ticket->state = Ticket::removed;
+            if (e.ticket->timer) e.ticket->timer->cancel();
+            post(move(e.fail), asio::error::operation_aborted);
+        }
+    }
+
+    node::admission_stats stats() const {
+        lock_guard<std::mutex> lock(_mutex);
+
+        node::admission_stats ret;
+        fill(ret.interactive, _classes[0]);
+        fill(ret.background,  _classes[1]);
+        return ret;
+    }
+
+private:
+    // Shared by a queued operation and its caller's Cancel. Once the
+    // operation starts, `cancel` is what cancels it.
+    struct Ticket {
+        enum State { queued, started, removed };
+
+        std::mutex mutex;
+        State state = queued;
+        sys::error_code error;
+        Cancel cancel;
+        unique_ptr<asio::steady_timer> timer;
+    };
+
+    struct Pending {
+        shared_ptr<Ticket> ticket;
+        Clock::time_point enqueued;
+        Clock::time_point deadline;
+        Start start;
+        Fail fail;
+    };
+
+    struct Class {
+        unsigned limit = 0;
+        unsigned running = 0;
+        deque<Pending> queue;
+        uint64_t admitted = 0;
+        uint64_t rejected = 0;
+        uint64_t expired = 0;
+        node::latency_histogram wait;
+    };
+
+    Class& get(node::priority_class p) {
+        return _classes[p == node::priority_class::background];
+    }
+
+    const Class& get(node::priority_class p) const {
+        return _classes[p == node::priority_class::background];
+    }
+
+    void post(Fail fail, sys::error_code ec) {
+        _ios.post([fail = move(fail), ec] { fail(ec); });
+    }
+
+    static void fill(node::admission_stats::queue& q, const Class& c) {
+        q.limit    = c.limit;
+        q.running  = c.running;
+        q.queued   = c.queue.size();
+        q.admitted = c.admitted;
+        q.rejected = c.rejected;
+        q.expired  = c.expired;
+        q.wait     = c.wait;
+    }
+
+    // Cancellation or expiry of a queued operation. Once the operation has
+    // started, cancellation is passed on to it and expiry is left to the
+    // deadline the operation was started with.
+    void remove( node::priority_class p
+               , const shared_ptr<Ticket>& t
+               , sys::error_code ec)
+    {
+        lock_guard<std::mutex> ticket_lock(t->mutex);
+
+        if (t->state == Ticket::started) {
+            if (ec == asio::error::operation_aborted) t->cancel();
+            return;
+        }
+
+        if (t->state == Ticket::removed) return;
+
+        t->state = Ticket::removed;
+        t->error = ec;
+        if (t->timer) t->timer->cancel();
+
+        Fail fail;
+
+        {
+            lock_guard<std::mutex> lock(_mutex);
+            auto& c = get(p);
+
+            if (ec == asio::error::timed_out) ++c.expired;
+
+            auto i = find_if(c.queue.begin(), c.queue.end(),
+                    [&] (const Pending& e) { return e.ticket == t; });
+
+            // Otherwise `release` has just taken it and fails it instead.
+            if (i == c.queue.end()) return;
+
+            fail = move(i->fail);
+            c.queue.erase(i);
+        }
+
+        post(move(fail), ec);
+    }
+
+private:
+    asio::io_service& _ios;
+    size_t _max_queued;
+    mutable std::mutex _mutex;
+    bool _closed = false;
+    Class _classes[2];
+};
+
+struct asio_ipfs::node_impl {
+    uint64_t ipfs_handle;
+    asio::io_service& ios;
+    shared_ptr<HandleContext> handles;
+    // Shared with pending `cat` callbacks. Null if disabled.
+    shared_ptr<detail::content_cache> cat_cache;
+    shared_ptr<SingleFlight> cat_flights;
+    shared_ptr<SingleFlight> resolve_flights;
+    shared_ptr<Admission> admission;
+
+    node_impl(asio::io_service& ios, uint64_t ipfs_handle, const node::config& cfg)
+        : ipfs_handle(ipfs_handle)
+        , ios(ios)
+        , handles(make_shared<HandleContext>(ios, ipfs_handle))
+        , cat_flights(make_shared<SingleFlight>(handles))
+        , resolve_flights(make_shared<SingleFlight>(handles))
+        , admission(make_shared<Admission>( ios
+                                          , cfg.max_interactive
+                                          , cfg.max_background
+                                          , cfg.max_queued))
+    {
+        if (cfg.cat_cache_size) {
+            cat_cache = make_shared<detail::content_cache>(cfg.cat_cache_size);
+        }
+    }
+};
+
+static
+node::priority_class effective_class(node::priority_class p, node::priority_class dflt)
+{
+    return p == node::priority_class::automatic ? dflt : p;
+}
+
+static
+Clock::time_point deadline_of(const node::call_options& o)
+{
+    if (o.timeout <= node::call_options().timeout) return Clock::time_point::max();
+    return Clock::now() + o.timeout;
+}
+
+/*
+ * Runs `start(cancel, cb)` right away, or once admission control lets it.
+ * `start` may be called after this returns, so it must own what it uses.
+ */
+template<class... As, class Start>
+static void admit( node_impl* impl
+                 , node::priority_class p
+                 , Clock::time_point deadline
+                 , function<void()>* cancel
+                 , Callback<As...> cb
+                 , Start start)
+{
+    auto& admission = impl->admission;
+
+    if (!admission->limited(p)) return start(cancel, move(cb));
+
+    auto cb_ = make_shared<Callback<As...>>(move(cb));
+
+    // A queued operation gets started with the cancel function of its
+    // admission ticket, which the caller's one passes cancellation on to.
+    admission->submit(p, deadline, cancel,
+        [ handles = impl->handles, admission, p, cb_
+        , start = move(start)] (function<void()>* cancel) {
+            start(cancel, continuation<As...>(handles,
+                [admission, p, cb_] (sys::error_code ec, As... as) {
+                    admission->release(p);
+                    (*cb_)(ec, move(as)...);
+                }));
+        },
+        [cb_] (sys::error_code ec) {
+            (*cb_)(ec, As()...);
+        });
+}
+
+
+
+// What `get_stats` gets told about an operation when it starts.
+struct OpInfo {
+    node::op_type type;
+    size_t bytes_out = 0;
+    Clock::time_point deadline = Clock::time_point::max();
+
+    OpInfo(node::op_type type, size_t bytes_out = 0)
+        : type(type), bytes_out(bytes_out) {}
+
+    OpInfo(node::op_type type, Clock::time_point deadline)
+        : type(type), deadline(deadline) {}
+
+    // What's left until the deadline, zero if there is none.
+    int64_t timeout_ns() const {
+        if (deadline == Clock::time_point::max()) return 0;
+        auto left = chrono::duration_cast<chrono::nanoseconds>(deadline - Clock::now());
+        return max<int64_t>(left.count(), 1);
+    }
+};
+
+// Operations whose result is content count it towards `bytes_in`.
+static size_t bytes_in(node::op_type t, const tuple<sys::error_code, string>& r)
+{
+    switch (t) {
+        case node::op_type::cat:
+        case node::op_type::cat_range:
+        case node::op_type::read: return get<1>(r).size();
+        default: return 0;
+    }
+}
+
+static size_t bytes_in(node::op_type, const tuple<sys::error_code, size_t>& r)
+{
+    // On failure the size is that of a block which didn't fit.
+    return get<0>(r) ? 0 : get<1>(r);
+}
+
+static size_t bytes_in(node::op_type, const tuple<sys::error_code, vector<size_t>>& r)
+{
+    if (get<0>(r)) return 0;
+    return accumulate(get<1>(r).begin(), get<1>(r).end(), size_t(0));
+}
+
+template<class Result>
+static size_t bytes_in(node::op_type, const Result&) { return 0; }
+
+template<class... As>
+struct Handle : public HandleBase, public Completion {
+    using Callback = ::Callback<As...>;
+    using Clock = detail::op_recorder::Clock;
+    using Outcome = detail::op_recorder::outcome;
+
+    shared_ptr<HandleContext> ctx;
+    Callback cb;
+    boost::optional<tuple<sys::error_code, As...>> result;
+    boost::optional<uint64_t> cancel_signal_id;
+    // Until Go is done with the operation.
+    boost::optional<asio::io_service::work> work;
+    asio_ipfs::node::op_type op;
+    Clock::time_point started;
+    Clock::time_point go_done;
+    Clock::time_point deadline;
+    // Set by `claim` in a go thread, read by `complete` in an asio thread.
+    bool claimed = false;
+
+    /*
+     * What the caller's cancel function is set to. The caller may invoke it
+     * at any time, also after the operation completed, and nothing else
+     * touches it once set. So it holds a job of its own, which keeps the
+     * handle (but not the operation) around until the caller reassigns or
+     * destroys its cancel function.
+     */
+    struct Canceller {
+        Handle* h;
+
+        explicit Canceller(Handle* h) : h(h) { ++h->job_count; }
+        Canceller(const Canceller& c) : h(c.h) { ++h->job_count; }
+        Canceller& operator=(const Canceller&) = delete;
+        ~Canceller() { h->release(); }
+
+        void operator()() const {
+            if (h->ctx->registry.claim_for_abort(*h)) h->abort();
+        }
+    };
+
+    static Handle* create( node_impl* impl
+                         , OpInfo info
+                         , boost::optional<uint64_t> cancel_signal_id
+                         , function<void()>* cancel
+                         , Callback cb)
+    {
+        void* mem = impl->handles->pool.allocate(sizeof(Handle));
+        return new (mem) Handle(impl, info, cancel_signal_id, cancel, move(cb));
+    }
+
+    Handle( node_impl* impl
+          , OpInfo info
+          , boost::optional<uint64_t> cancel_signal_id_
+          , function<void()>* cancel
+          , Callback cb_)
+        : ctx(impl->handles)
+        , cb(move(cb_))
+        , cancel_signal_id(cancel_signal_id_)
+        , work(asio::io_service::work(impl->ios))
+        , op(info.type)
+        , started(Clock::now())
+        , deadline(info.deadline)
+    {
+        ctx->stats.start(op, info.bytes_out);
+
+        if (cancel) *cancel = Canceller(this);
+
+        ctx->registry.insert(*this);
+
+        /*
+         * Exactly one of complete() with a successful claim and abort() is
+         * ever called, in an asio thread.
+         */
+    }
+
+    /*
+     * This function is always called, in a go thread. The result is handed
+     * over to the asio thread through the completion queue.
+     */
+    static void call(int err, void* arg, As... args) {
+        auto self = reinterpret_cast<Handle*>(arg);
+        self->go_done = Clock::now();
+        self->result.emplace(make_error_code(error::ipfs_error{err}), std::move(args)...);
+        // Keep the context alive, pushing may be the last thing that
+        // happens to this handle before it gets deleted.
+        auto ctx = self->ctx;
+        ctx->complete(self);
+    }
+
+    /*
+     * For results Go writes straight into the caller's memory: called in a
+     * go thread before writing, claims the handle so that it can no longer
+     * be aborted, and the memory handed back to the caller. Go must not
+     * write if this returns 0. `call` must follow either way.
+     */
+    static int claim(void* arg) {
+        auto self = reinterpret_cast<Handle*>(arg);
+        self->claimed = self->ctx->registry.claim(*self);
+        return self->claimed;
+    }
+
+    /*
+     * Called in an asio thread, once Go is done with the operation.
+     */
+    void complete() override {
+        auto on_exit = defer([&] {
+                work = boost::none;
+                release();
+            });
+
+        if (!claimed && !ctx->registry.claim(*this)) return; // Aborted
+
+        if (cancel_signal_id) {
+            go_asio_ipfs_cancellation_free(ctx->ipfs_handle, *cancel_signal_id);
+        }
+
+        auto now = Clock::now();
+
+        // Go only tells us the operation failed, but that's most likely
+        // because its context ran out of time.
+        auto& ec = std::get<0>(*result);
+        if (ec && now >= deadline) ec = asio::error::timed_out;
+
+        ctx->stats.completion_delay(now - go_done);
+        ctx->stats.finish( op
+                         , std::get<0>(*result) ? Outcome::failed : Outcome::succeeded
+                         , now - started
+                         , bytes_in(op, *result));
+
+        Callback callback = move(cb);
+        std::experimental::apply(callback, std::move(*result));
+    }
+
+    void abort() override {
+        if (cancel_signal_id) {
+            go_asio_ipfs_cancel(ctx->ipfs_handle, *cancel_signal_id);
+        }
+
+        ctx->stats.finish(op, Outcome::aborted, Clock::now() - started, 0);
+
+        post_handler(ctx->ios, [this, callback = move(cb)] () mutable {
+            auto on_exit = defer([&] { release(); });
+
+            tuple<sys::error_code, As...> args;
+            std::get<0>(args) = asio::error::operation_aborted;
+            std::experimental::apply(callback, std::move(args));
+        });
+    }
+
+    void release() {
+        if (--job_count) return;
+        auto c = move(ctx);
+        this->~Handle();
+        c->pool.deallocate(this, sizeof(Handle));
+    }
+};
+
+template<class... As> struct callback_function;
+
+template<> struct callback_function<> {
+    static void callback(int err, void* arg) {
+        Handle<>::call(err, arg);
+    }
+};
+
+template<> struct callback_function<std::string> {
+    static void callback(int err, const char* data, size_t size, void* arg) {
+        Handle<std::string>::call(err, arg, std::string(data, data + size));
+    }
+};
+
+// Newline separated list of strings.
+template<> struct callback_function<std::vector<std::string>> {
+    static void callback(int err, const char* data, size_t size, void* arg) {
+        std::vector<std::string> ret;
+
+        for (const char* p = data, *end = data + size; p != end;) {
+            const char* q = std::find(p, end, '\n');
+            ret.emplace_back(p, q);
+            p = (q == end) ? q : q + 1;
+        }
+
+        Handle<std::vector<std::string>>::call(err, arg, std::move(ret));
+    }
+};
+
+// Four uint64_t values, see go_asio_ipfs_gc.
+template<> struct callback_function<node::gc_result> {
+    static void callback(int err, const char* data, size_t size, void* arg) {
+        node::gc_result ret;
+
+        if (size == 4 * sizeof(uint64_t)) {
+            uint64_t v[4];
+            memcpy(v, data, size);
+            ret.blocks_removed = v[0];
+            ret.bytes_freed    = v[1];
+            ret.duration       = std::chrono::nanoseconds(v[2]);
+            ret.complete       = v[3];
+        }
+
+        Handle<node::gc_result>::call(err, arg, ret);
+    }
+};
+
+// The block itself has already been written to the caller's buffer, see
+// go_asio_ipfs_block_get.
+template<> struct callback_function<size_t> {
+    static void callback(int err, const char*, size_t size, void* arg) {
+        Handle<size_t>::call(err, arg, size);
+    }
+};
+
+// One uint64_t size per block, see go_asio_ipfs_block_get_many.
+template<> struct callback_function<std::vector<size_t>> {
+    static void callback(int err, const char* data, size_t size, void* arg) {
+        std::vector<size_t> ret(size / sizeof(uint64_t));
+
+        for (size_t i = 0; i < ret.size(); ++i) {
+            uint64_t v;
+            memcpy(&v, data + i * sizeof(v), sizeof(v));
+            ret[i] = v;
+        }
+
+        Handle<std::vector<size_t>>::call(err, arg, std::move(ret));
+    }
+};
+
+// Two uint64_t values, see go_asio_ipfs_prefetch.
+template<> struct callback_function<node::prefetch_result> {
+    static void callback(int err, const char* data, size_t size, void* arg) {
+        node::prefetch_result ret;
+
+        if (size == 2 * sizeof(uint64_t)) {
+            uint64_t v[2];
+            memcpy(v, data, size);
+            ret.blocks = v[0];
+            ret.bytes  = v[1];
+        }
+
+        Handle<node::prefetch_result>::call(err, arg, ret);
+    }
+};
+
+// Returns the cancel signal id of the started operation.
+template<class... CbAs, class F, class... As>
+uint64_t call_ipfs(
+    node_impl* node,
+    OpInfo info,
+    std::function<void()>* cancel,
+    Callback<CbAs...> callback,
+    F ipfs_function,
+    As... args
+) {
+    uint64_t cancel_signal_id = go_asio_ipfs_cancellation_allocate( node->ipfs_handle
+                                                                  , info.timeout_ns());
+
+    ipfs_function(
+        node->ipfs_handle,
+        cancel_signal_id,
+        args...,
+        (void*) &callback_function<CbAs...>::callback,
+        (void*) Handle<CbAs...>::create(node, info, cancel_signal_id, cancel, std::move(callback))
+    );
+
+    return cancel_signal_id;
+}
+
+template<class... CbAs, class F, class... As>
+void call_ipfs_nocancel(
+    node_impl* node,
+    OpInfo info,
+    std::function<void()>* cancel,
+    Callback<CbAs...> callback,
+    F ipfs_function,
+    As... args
+) {
+    ipfs_function(
+        node->ipfs_handle,
+        args...,
+        (void*) &callback_function<CbAs...>::callback,
+        (void*) Handle<CbAs...>::create(node, info, boost::none, cancel, std::move(callback))
+    );
+}
+
+static
+const char* datastore_name(node::datastore_type t)
+{
+    switch (t) {
+        case node::datastore_type::flatfs:  return "flatfs";
+        case node::datastore_type::leveldb: return "leveldb";
+        case node::datastore_type::badger:  return "badger";
+        case node::datastore_type::memory:  return "memory";
+    }
+
+    return "flatfs";
+}
+
+static
+const char* identity_name(node::identity_type t)
+{
+    switch (t) {
+        case node::identity_type::rsa:     return "rsa";
+        case node::identity_type::ed25519: return "ed25519";
+    }
+
+    return "rsa";
+}
+
+static
+string config_to_json(node::config cfg)
+{
+    stringstream ss;
+
+    // Poor man's json
+    ss << "{"
+       <<     "\"Online\": " << (cfg.online ? "true" : "false") << ","
+       <<     "\"LowWater\": " << cfg.low_water << ","
+       <<     "\"HighWater\": " << cfg.high_water << ","
+       <<     "\"GracePeriod\": \"" << cfg.grace_period << "s\","
+       <<     "\"Filestore\": " << (cfg.filestore ? "true" : "false") << ","
+       <<     "\"Datastore\": \"" << datastore_name(cfg.datastore) << "\","
+       <<     "\"PublishDebounce\": \"" << cfg.publish_debounce << "ms\","
+       <<     "\"GCHighWatermark\": " << cfg.gc_high_watermark << ","
+       <<     "\"Identity\": \"" << identity_name(cfg.identity) << "\","
+       <<     "\"LazyBootstrap\": " << (cfg.lazy_bootstrap ? "true" : "false") << ","
+       <<     "\"HttpApi\": " << (cfg.http_api ? "true" : "false") << ","
+       <<     "\"Bootstrap\": " << (cfg.bootstrap ? "true" : "false")
+       << "}";
+
+    return ss.str();
+}
+
+node::node(asio::io_service& ios, const string& repo_path, config cfg)
+{
+    string cfg_s = config_to_json(cfg);
+
+    uint64_t ipfs_handle = go_asio_ipfs_allocate();
+    int ec = go_asio_ipfs_start_blocking( ipfs_handle
+                                        , (char*) cfg_s.c_str()
+                                        , (char*) repo_path.data());
+
+    if (ec != IPFS_SUCCESS) {
+        go_asio_ipfs_free(ipfs_handle);
+        throw std::runtime_error("node: Failed to start IPFS");
+    }
+
+    _impl = make_unique<node_impl>(ios, ipfs_handle, cfg);
+}
+
+void node::build_( asio::io_service& ios
+                 , const string& repo_path
+                 , config cfg
+                 , Cancel* cancel
+                 , Callback<unique_ptr<node>> cb)
+{
+    // Owned by the continuation below, the pool it comes from is part of it.
+    auto impl = new node_impl(ios, go_asio_ipfs_allocate(), cfg);
+
+    auto cb_ = continuation<>(impl->handles,
+        [cb = move(cb), impl] (sys::error_code ec) mutable {
+            if (ec) {
+                go_asio_ipfs_free(impl->ipfs_handle);
+                delete impl;
+                cb(ec, nullptr);
+            } else {
+                std::unique_ptr<node> node_(new node);
+                node_->_impl = unique_ptr<node_impl>(impl);
+                cb(ec, std::move(node_));
+            }
+        });
+
+    string cfg_s = config_to_json(cfg);
+
+    call_ipfs_nocancel( impl
+                      , node::op_type::build
+                      , cancel
+                      , move(cb_)
+                      , go_asio_ipfs_start_async, (char*) cfg_s.c_str()
+                                                , (char*) repo_path.data());
+}
+
+node::node() = default;
+node::node(node&&) = default;
+node& node::operator=(node&&) = default;
+
+
+string node::id() const {
+    char* cid = go_asio_ipfs_node_id(_impl->ipfs_handle);
+    string ret(cid);
+    free(cid);
+    return ret;
+}
+
+vector<string> node::swarm_addresses() const
+{
+    char* addrs = go_asio_ipfs_swarm_addrs(_impl->ipfs_handle);
+
+    vector<string> ret;
+    stringstream ss(addrs);
+    string addr;
+
+    while (getline(ss, addr)) {
+        if (!addr.empty()) ret.push_back(move(addr));
+    }
+
+    free(addrs);
+    return ret;
+}
+
+void node::connect_( const string& address
+                   , Cancel* cancel
+                   , Callback<> cb)
+{
+    call_ipfs( _impl.get(), op_type::connect, cancel, move(cb)
+             , go_asio_ipfs_swarm_connect, (char*) address.c_str());
+}
+
+void node::publish_( const string& cid
+                   , Timer::duration d
+                   , Cancel* cancel
+                   , Callback<> cb)
+{
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(d).count();
+
+    if (seconds < 1) {
+        if (cancel) *cancel = []{};
+        post_handler(_impl->ios, [cb = move(cb)] () mutable { cb(asio::error::invalid_argument); });
+        return;
+    }
+
+    call_ipfs(_impl.get(), op_type::publish, cancel, move(cb), go_asio_ipfs_publish, (char*) cid.data(), cid.size(), seconds);
+}
+
+void node::stop_republishing()
+{
+    go_asio_ipfs_stop_republishing(_impl->ipfs_handle);
+}
+
+void node::resolve_( const string& node_id
+                   , bool fresh
+                   , const call_options& options
+                   , Cancel* cancel
+                   , Callback<string> cb)
+{
+    auto deadline = deadline_of(options);
+    auto p = effective_class(options.priority, priority_class::interactive);
+
+    admit(_impl.get(), p, deadline, cancel, move(cb),
+        [impl = _impl.get(), node_id, fresh, deadline]
+        (Cancel* cancel, Callback<string> cb) {
+            // Don't let a fresh resolution join one which may be served
+            // from cache.
+            string key = fresh ? "!" + node_id : node_id;
+
+            impl->resolve_flights->join(key, deadline, cancel, move(cb),
+                [&] (SingleFlight::Callback cb) {
+                    return call_ipfs( impl, op_type::resolve, nullptr, move(cb)
+                                    , go_asio_ipfs_resolve, (char*) node_id.c_str()
+                                                          , fresh);
+                });
+        });
+}
+
+// Appends `s` as a quoted JSON string.
+static
+void write_json_string(string& out, const string& s)
+{
+    out += '"';
+
+    for (char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            default:
+                if ((unsigned char) c < 0x20) {
+                    static const char* hex = "0123456789abcdef";
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xf];
+                } else {
+                    out += c;
+                }
+        }
+    }
+
+    out += '"';
+}
+
+/*
+ * Go parses the options before the call they are passed to returns, so they
+ * are written to a buffer of the calling thread which the next call reuses.
+ */
+static
+const char* add_options_to_json(const node::add_options& o)
+{
+    static thread_local string json;
+
+    json = "{\"Chunker\": ";
+    write_json_string(json, o.chunker);
+    json += ", \"Hash\": ";
+    write_json_string(json, o.hash);
+
+    // Left out unless set, so that go-ipfs derives them from the rest.
+    if (o.raw_leaves) {
+        json += ", \"RawLeaves\": ";
+        json += *o.raw_leaves ? "true" : "false";
+    }
+
+    if (o.cid_version) {
+        json += ", \"CidVersion\": ";
+        json += to_string(*o.cid_version);
+    }
+
+    json += "}";
+
+    return json.c_str();
+}
+
+void node::add_( const uint8_t* data
+               , size_t size
+               , const add_options& options
+               , Cancel* cancel
+               , Callback<string> cb)
+{
+    const char* opts = add_options_to_json(options);
+
+    call_ipfs_nocancel( _impl.get(), {op_type::add, size}, cancel, move(cb)
+                      , go_asio_ipfs_add, (void*) data, size, (char*) opts);
+}
+
+void node::add_batch_( const vector<asio::const_buffer>& buffers
+                     , const add_options& options
+                     , Cancel* cancel
+                     , Callback<vector<string>> cb)
+{
+    vector<void*> datas;
+    vector<size_t> sizes;
+    size_t total = 0;
+
+    datas.reserve(buffers.size());
+    sizes.reserve(buffers.size());
+
+    for (auto& b : buffers) {
+        datas.push_back((void*) asio::buffer_cast<const void*>(b));
+        sizes.push_back(asio::buffer_size(b));
+        total += sizes.back();
+    }
+
+    const char* opts = add_options_to_json(options);
+
+    call_ipfs_nocancel( _impl.get(), {op_type::add_batch, total}, cancel, move(cb)
+                      , go_asio_ipfs_add_batch, datas.data()
+                                              , sizes.data()
+                                              , buffers.size()
+                                              , (char*) opts);
+}
+
+void node::add_file_( const string& path
+                    , const add_options& options
+                    , Cancel* cancel
+                    , Callback<string> cb)
+{
+    const char* opts = add_options_to_json(options);
+
+    call_ipfs( _impl.get(), op_type::add_file, cancel, move(cb)
+             , go_asio_ipfs_add_file, (char*) path.c_str(), (char*) opts);
+}
+
+// Inputs bigger than this are hashed on a thread of their own, so that they
+// don't hold up other handlers of the io_service.
+static const size_t max_inline_cid_size = 1024 * 1024;
+
+void node::calculate_cid_( const string_view data
+                         , Cancel* cancel
+                         , Callback<string> cb)
+{
+    // Hashing can't be interrupted, there's nothing to cancel.
+    if (cancel) *cancel = []{};
+
+    auto& ios = _impl->ios;
+
+    if (data.size() > max_inline_cid_size) {
+        // Shared, so that it's still here if the thread doesn't start.
+        auto cb_ = make_shared<Callback<string>>(move(cb));
+
+        try {
+            thread([&ios, work = asio::io_service::work(ios), data, cb_] {
+                    post_handler(ios, [cb_, cid = asio_ipfs::calculate_cid(data)] () mutable {
+                        (*cb_)(sys::error_code(), move(cid));
+                    });
+                }).detach();
+            return;
+        }
+        catch (const system_error&) {
+            // No thread to be had, hash it here after all.
+            cb = move(*cb_);
+        }
+    }
+
+    post_handler(ios, [cb = move(cb), cid = asio_ipfs::calculate_cid(data)] () mutable {
+        cb(sys::error_code(), move(cid));
+    });
+}
+
+// Content named by a CID never changes, so only that may be cached: a bare
+// CID, possibly followed by a path within it, or an /ipfs/ path. What an
+// /ipns/ path refers to changes whenever the name is published again.
+static bool immutable(boost::string_view path)
+{
+    return !path.starts_with('/') || path.starts_with("/ipfs/");
+}
+
+void node::cat_( string_view cid
+               , const call_options& options
+               , Cancel* cancel
+               , Callback<string> cb)
+{
+    bool cacheable = _impl->cat_cache && immutable(cid);
 
-struct asio_ipfs::node_impl {
-    uint64_t ipfs_handle;
-    asio::io_service& ios;
-    intr::list<HandleBase, intr::constant_time_size<false>> handles;
+    if (cacheable) {
+        if (auto data = _impl->cat_cache->get(cid)) {
+            if (cancel) *cancel = []{};
 
-    node_impl(asio::io_service& ios)
-        : ios(ios)
-    {}
-};
+            post_handler(_impl->ios, [cb = move(cb), data = move(*data)] () mutable {
+                cb(sys::error_code(), move(data));
+            });
+            return;
+        }
+    }
 
+    auto deadline = deadline_of(options);
+    auto p = effective_class(options.priority, priority_class::interactive);
 
+    auto start = [impl = _impl.get(), deadline, cacheable]
+                 (string_view key, Cancel* cancel, Callback<string> cb) {
+        impl->cat_flights->join(key, deadline, cancel, move(cb),
+            [&] (SingleFlight::Callback cb) {
+                if (cacheable) {
+                    auto& cache = impl->cat_cache;
+                    cb = continuation<string>(impl->handles,
+                        [cb = move(cb), cache, key = key.to_string()]
+                        (sys::error_code ec, string data) mutable {
+                            if (!ec) cache->put(key, data);
+                            cb(ec, move(data));
+                        });
+                }
 
-template<class... As>
-struct Handle : public HandleBase {
-    asio::io_service& ios;
-    uint64_t ipfs_handle;
-    function<void(sys::error_code, As&&...)> cb;
-    function<void()>* cancel_fn;
-    function<void()> destructor_cancel_fn;
-    boost::optional<uint64_t> cancel_signal_id;
-    asio::io_service::work work;
-    unsigned job_count = 1;
+                return call_ipfs( impl, op_type::cat, nullptr, move(cb)
+                                , go_asio_ipfs_cat, (char*) key.data(), key.size());
+            });
+    };
 
-    Handle( node_impl* impl
-          , boost::optional<uint64_t> cancel_signal_id_
-          , function<void()>* cancel_fn_
-          , function<void(sys::error_code, As&&...)> cb_)
-        : ios(impl->ios)
-        , ipfs_handle(impl->ipfs_handle)
-        , cancel_fn(cancel_fn_ ? cancel_fn_ : &destructor_cancel_fn)
-        , cancel_signal_id(cancel_signal_id_)
-        , work(asio::io_service::work(ios))
-    {
-        impl->handles.push_back(*this);
+    // Only a queued cat needs a copy of the CID.
+    if (!_impl->admission->limited(p)) return start(cid, cancel, move(cb));
 
-        cb = [this, cb_ = std::move(cb_)] (sys::error_code ec, As... args) {
-            (*cancel_fn) = []{};
-            if (cancel_signal_id) {
-                go_asio_ipfs_cancellation_free(ipfs_handle, *cancel_signal_id);
-            }
-            // We need to unlink here, othersize the callback could invoke the
-            // destructor, which would in turn call `cancel` and expect that it
-            // gets unlinked. But we just set the `cancel_fn` to do nothing
-            // above, so the destructor ends up in an infinite loop.
-            unlink();
-            std::experimental::apply(cb_, make_tuple(ec, std::move(args)...));
-        };
+    admit(_impl.get(), p, deadline, cancel, move(cb),
+        [start, key = cid.to_string()] (Cancel* cancel, Callback<string> cb) {
+            start(key, cancel, move(cb));
+        });
+}
 
-        *cancel_fn = [this] {
-            unlink();
-            if (cancel_signal_id) {
-                go_asio_ipfs_cancel(ipfs_handle, *cancel_signal_id);
-            }
+node::writer node::add_stream()
+{
+    return add_stream(add_options());
+}
 
-            assert(cb);
-            assert(job_count);
-            ++job_count;
+node::writer node::add_stream(const add_options& options)
+{
+    const char* opts = add_options_to_json(options);
+    uint64_t id = go_asio_ipfs_writer_allocate( _impl->ipfs_handle
+                                              , (char*) opts);
+    return writer(_impl.get(), id);
+}
 
-            ios.post([this, callback = std::move(cb)] {
-                auto on_exit = defer([&] { if (!--job_count) delete(this); });
+void node::cat_range_( string_view cid
+                     , uint64_t offset
+                     , uint64_t length
+                     , const call_options& options
+                     , Cancel* cancel
+                     , Callback<string> cb)
+{
+    // Ranges are served from whole cached contents, but not cached themselves.
+    if (_impl->cat_cache && immutable(cid)) {
+        if (auto data = _impl->cat_cache->get_range(cid, offset, length)) {
+            if (cancel) *cancel = []{};
 
-                tuple<sys::error_code, As...> args;
-                std::get<0>(args) = asio::error::operation_aborted;
-                std::experimental::apply(callback, std::move(args));
+            post_handler(_impl->ios, [cb = move(cb), data = move(*data)] () mutable {
+                cb(sys::error_code(), move(data));
             });
+            return;
+        }
+    }
 
-            (*cancel_fn) = []{};
-        };
+    auto deadline = deadline_of(options);
+    auto p = effective_class(options.priority, priority_class::interactive);
 
-        /*
-         * Exactly one of cb and *cancel_fn is ever called, in the asio thread.
-         */
-    }
+    admit(_impl.get(), p, deadline, cancel, move(cb),
+        [impl = _impl.get(), cid = cid.to_string(), offset, length, deadline]
+        (Cancel* cancel, Callback<string> cb) {
+            call_ipfs( impl, {op_type::cat_range, deadline}, cancel, move(cb)
+                     , go_asio_ipfs_cat_range, (char*) cid.data(), cid.size()
+                                             , offset, length);
+        });
+}
 
-    /*
-     * This function is always called, in a go thread. If the Handle was
-     * cancelled, self->cb is empty.
-     */
-    static void call(int err, void* arg, As... args) {
-        auto self = reinterpret_cast<Handle*>(arg);
-        self->ios.post([
-            self,
-            full_args = make_tuple(make_error_code(error::ipfs_error{err}), std::move(args)...)
-        ] {
-            auto on_exit = defer([&] { if (!--self->job_count) delete(self); });
-
-            if (self->cb) {
-                std::experimental::apply(self->cb, tuple<sys::error_code, As...>(std::move(full_args)));
-            }
+node::reader node::cat_stream(string_view cid)
+{
+    return cat_stream(cid, 0, numeric_limits<uint64_t>::max());
+}
+
+node::reader node::cat_stream(string_view cid, uint64_t offset, uint64_t length)
+{
+    uint64_t id = go_asio_ipfs_reader_allocate( _impl->ipfs_handle
+                                              , (char*) cid.data()
+                                              , cid.size()
+                                              , offset
+                                              , length);
+    return reader(_impl.get(), id);
+}
+
+void node::pin_( const string& cid
+               , const call_options& options
+               , Cancel* cancel
+               , Callback<> cb)
+{
+    auto deadline = deadline_of(options);
+    auto p = effective_class(options.priority, priority_class::background);
+
+    admit(_impl.get(), p, deadline, cancel, move(cb),
+        [impl = _impl.get(), cid, deadline]
+        (Cancel* cancel, Callback<> cb) {
+            call_ipfs( impl, {op_type::pin, deadline}, cancel, move(cb)
+                     , go_asio_ipfs_pin, (char*) cid.data(), cid.size());
         });
-    }
+}
+
+void node::unpin_( const string& cid
+                 , Cancel* cancel
+                 , Callback<> cb)
+{
+    call_ipfs(_impl.get(), op_type::unpin, cancel, move(cb), go_asio_ipfs_unpin, (char*) cid.data(), cid.size());
+}
+
+// Hands progress reports of a `pin_many` over to the io_service. Go reports
+// one last time with `last` set, after which this is no longer used.
+struct PinProgress {
+    asio::io_service& ios;
+    shared_ptr<function<void(const node::pin_progress&)>> on_progress;
+    size_t cids_total;
+    // Cleared once the operation's handler has been called, reports still
+    // coming from Go after an abort are dropped.
+    shared_ptr<atomic<bool>> live;
+
+    static void callback( uint64_t blocks
+                        , uint64_t bytes
+                        , uint64_t done
+                        , int last
+                        , void* arg)
+    {
+        auto self = reinterpret_cast<PinProgress*>(arg);
+
+        node::pin_progress p;
+        p.blocks     = blocks;
+        p.bytes      = bytes;
+        p.cids_done  = done;
+        p.cids_total = self->cids_total;
+
+        self->ios.post([f = self->on_progress, live = self->live, p] {
+                if (*live) (*f)(p);
+            });
 
-    void cancel() override {
-        (*cancel_fn)();
+        if (last) delete self;
     }
 };
 
-template<class... As> struct callback_function;
+static string join_lines(const vector<string>& v)
+{
+    string ret;
 
-template<> struct callback_function<> {
-    static void callback(int err, void* arg) {
-        Handle<>::call(err, arg);
+    for (auto& s : v) {
+        ret += s;
+        ret += '\n';
     }
-};
 
-template<> struct callback_function<std::string> {
-    static void callback(int err, const char* data, size_t size, void* arg) {
-        Handle<std::string>::call(err, arg, std::string(data, data + size));
+    return ret;
+}
+
+void node::pin_many_( const vector<string>& cids
+                    , pin_options options
+                    , const call_options& call
+                    , Cancel* cancel
+                    , Callback<> cb)
+{
+    shared_ptr<function<void(const pin_progress&)>> on_progress;
+
+    if (options.on_progress) {
+        on_progress = make_shared<function<void(const pin_progress&)>>
+                          (move(options.on_progress));
     }
-};
 
-template<class... CbAs, class F, class... As>
-void call_ipfs(
-    node_impl* node,
-    std::function<void()>* cancel,
-    std::function<void(sys::error_code, CbAs...)> callback,
-    F ipfs_function,
-    As... args
-) {
-    uint64_t cancel_signal_id = go_asio_ipfs_cancellation_allocate(node->ipfs_handle);
+    auto deadline = deadline_of(call);
+    auto p = effective_class(call.priority, priority_class::background);
 
-    ipfs_function(
-        node->ipfs_handle,
-        cancel_signal_id,
-        args...,
-        (void*) &callback_function<CbAs...>::callback,
-        (void*) (new Handle<CbAs...>{ node, cancel_signal_id, cancel, std::move(callback) })
-    );
+    admit(_impl.get(), p, deadline, cancel, move(cb),
+        [ impl = _impl.get(), cids_s = join_lines(cids), cids_total = cids.size()
+        , parallelism = options.parallelism, on_progress, deadline]
+        (Cancel* cancel, Callback<> cb) {
+            // Go frees this with its last report, so it's only made once
+            // the operation actually starts.
+            PinProgress* progress = nullptr;
+
+            if (on_progress) {
+                auto live = make_shared<atomic<bool>>(true);
+
+                progress = new PinProgress{impl->ios, on_progress, cids_total, live};
+
+                cb = continuation<>(impl->handles,
+                    [cb = move(cb), live] (sys::error_code ec) mutable {
+                        *live = false;
+                        cb(ec);
+                    });
+            }
+
+            call_ipfs( impl, {op_type::pin_many, deadline}, cancel, move(cb)
+                     , go_asio_ipfs_pin_many, (char*) cids_s.c_str()
+                                            , (int) parallelism
+                                            , progress ? (void*) &PinProgress::callback : nullptr
+                                            , (void*) progress);
+        });
 }
 
-template<class... CbAs, class F, class... As>
-void call_ipfs_nocancel(
-    node_impl* node,
-    std::function<void()>* cancel,
-    std::function<void(sys::error_code, CbAs...)> callback,
-    F ipfs_function,
-    As... args
-) {
-    ipfs_function(
-        node->ipfs_handle,
-        args...,
-        (void*) &callback_function<CbAs...>::callback,
-        (void*) (new Handle<CbAs...>{ node, boost::none, cancel, std::move(callback) })
-    );
+void node::prefetch_( const string& cid
+                    , prefetch_options options
+                    , const call_options& call
+                    , Cancel* cancel
+                    , Callback<prefetch_result> cb)
+{
+    auto deadline = deadline_of(call);
+    auto p = effective_class(call.priority, priority_class::background);
+
+    admit(_impl.get(), p, deadline, cancel, move(cb),
+        [impl = _impl.get(), cid, options, deadline]
+        (Cancel* cancel, Callback<prefetch_result> cb) {
+            call_ipfs( impl, {op_type::prefetch, deadline}, cancel, move(cb)
+                     , go_asio_ipfs_prefetch, (char*) cid.data(), cid.size()
+                                            , (int) options.parallelism
+                                            , options.pin);
+        });
 }
 
+void node::unpin_many_( const vector<string>& cids
+                      , Cancel* cancel
+                      , Callback<> cb)
+{
+    string cids_s = join_lines(cids);
+
+    call_ipfs( _impl.get(), op_type::unpin_many, cancel, move(cb)
+             , go_asio_ipfs_unpin_many, (char*) cids_s.c_str());
+}
+
+// Format names of the CoreAPI's block put options.
 static
-string config_to_json(node::config cfg)
+const char* block_format(node::block_codec c)
 {
-    stringstream ss;
+    switch (c) {
+        case node::block_codec::raw:      return "raw";
+        case node::block_codec::dag_pb:   return "v0";
+        case node::block_codec::dag_cbor: return "cbor";
+    }
 
-    // Poor man's json
-    ss << "{"
-       <<     "\"Online\": " << (cfg.online ? "true" : "false") << ","
-       <<     "\"LowWater\": " << cfg.low_water << ","
-       <<     "\"HighWater\": " << cfg.high_water << ","
-       <<     "\"GracePeriod\": \"" << cfg.grace_period << "s\""
-       << "}";
+    return "raw";
+}
 
-    return ss.str();
+void node::block_put_( asio::const_buffer data
+                     , block_codec codec
+                     , Cancel* cancel
+                     , Callback<string> cb)
+{
+    block_put_many_({data}, codec, cancel,
+        continuation<vector<string>>(_impl->handles,
+            [cb = move(cb)] (sys::error_code ec, vector<string> cids) mutable {
+                cb(ec, cids.size() == 1 ? move(cids[0]) : string());
+            }));
 }
 
-node::node(asio::io_service& ios, const string& repo_path, config cfg)
+void node::block_put_many_( const vector<asio::const_buffer>& buffers
+                          , block_codec codec
+                          , Cancel* cancel
+                          , Callback<vector<string>> cb)
 {
-    string cfg_s = config_to_json(cfg);
+    vector<void*> datas;
+    vector<size_t> sizes;
+    size_t total = 0;
 
-    uint64_t ipfs_handle = go_asio_ipfs_allocate();
-    int ec = go_asio_ipfs_start_blocking( ipfs_handle
-                                        , (char*) cfg_s.c_str()
-                                        , (char*) repo_path.data());
+    datas.reserve(buffers.size());
+    sizes.reserve(buffers.size());
 
-    if (ec != IPFS_SUCCESS) {
-        go_asio_ipfs_free(ipfs_handle);
-        throw std::runtime_error("node: Failed to start IPFS");
+    for (auto& b : buffers) {
+        datas.push_back((void*) asio::buffer_cast<const void*>(b));
+        sizes.push_back(asio::buffer_size(b));
+        total += sizes.back();
     }
 
-    _impl = make_unique<node_impl>(ios);
-    _impl->ipfs_handle = ipfs_handle;
+    call_ipfs_nocancel( _impl.get(), {op_type::block_put, total}, cancel, move(cb)
+                      , go_asio_ipfs_block_put, datas.data()
+                                              , sizes.data()
+                                              , buffers.size()
+                                              , (char*) block_format(codec));
 }
 
-void node::build_( asio::io_service& ios
-                 , const string& repo_path
-                 , config cfg
-                 , Cancel* cancel
-                 , function<void( const sys::error_code& ec
-                                , unique_ptr<node>)> cb)
+void node::block_get_( const string& cid
+                     , asio::mutable_buffer buffer
+                     , Cancel* cancel
+                     , Callback<size_t> cb)
 {
-    /*
-     * This cannot be a unique_ptr, because std::function wants to be
-     * CopyConstructible for some reason.
-     */
-    auto impl = new node_impl(ios);
-    impl->ipfs_handle = go_asio_ipfs_allocate();
-
-    std::function<void(sys::error_code)> cb_ = [cb = move(cb), impl] (sys::error_code ec) {
-        if (ec) {
-            go_asio_ipfs_free(impl->ipfs_handle);
-            delete impl;
-            cb(ec, nullptr);
-        } else {
-            std::unique_ptr<node> node_(new node);
-            node_->_impl = unique_ptr<node_impl>(impl);
-            cb(ec, std::move(node_));
-        }
-    };
+    call_ipfs( _impl.get(), op_type::block_get, cancel, move(cb)
+             , go_asio_ipfs_block_get, (char*) cid.data(), cid.size()
+                                     , asio::buffer_cast<void*>(buffer)
+                                     , asio::buffer_size(buffer)
+                                     , (void*) &Handle<size_t>::claim);
+}
 
-    string cfg_s = config_to_json(cfg);
+void node::block_get_many_( const vector<string>& cids
+                          , const vector<asio::mutable_buffer>& buffers
+                          , Cancel* cancel
+                          , Callback<vector<size_t>> cb)
+{
+    if (cids.size() != buffers.size()) {
+        if (cancel) *cancel = []{};
+        post_handler(_impl->ios, [cb = move(cb)] () mutable {
+            cb(asio::error::invalid_argument, vector<size_t>());
+        });
+        return;
+    }
 
-    call_ipfs_nocancel( impl
-                      , cancel
-                      , cb_
-                      , go_asio_ipfs_start_async, (char*) cfg_s.c_str()
-                                                , (char*) repo_path.data());
+    vector<void*> dsts;
+    vector<size_t> sizes;
+
+    dsts.reserve(buffers.size());
+    sizes.reserve(buffers.size());
+
+    for (auto& b : buffers) {
+        dsts.push_back(asio::buffer_cast<void*>(b));
+        sizes.push_back(asio::buffer_size(b));
+    }
+
+    string cids_s = join_lines(cids);
+
+    call_ipfs( _impl.get(), op_type::block_get, cancel, move(cb)
+             , go_asio_ipfs_block_get_many, (char*) cids_s.c_str()
+                                          , dsts.data()
+                                          , sizes.data()
+                                          , buffers.size()
+                                          , (void*) &Handle<vector<size_t>>::claim);
 }
 
-node::node() = default;
-node::node(node&&) = default;
-node& node::operator=(node&&) = default;
+void node::gc_( gc_budget budget
+              , Cancel* cancel
+              , Callback<gc_result> cb)
+{
+    using namespace std::chrono;
 
+    call_ipfs( _impl.get(), op_type::gc, cancel, move(cb)
+             , go_asio_ipfs_gc, (int64_t) duration_cast<nanoseconds>(budget.time).count()
+                              , (uint64_t) budget.blocks);
+}
 
-string node::id() const {
-    char* cid = go_asio_ipfs_node_id(_impl->ipfs_handle);
-    string ret(cid);
-    free(cid);
+node::completion_stats node::get_completion_stats() const
+{
+    return _impl->handles->completions.stats();
+}
+
+node::stats node::get_stats() const
+{
+    return _impl->handles->stats.snapshot();
+}
+
+node::admission_stats node::get_admission_stats() const
+{
+    return _impl->admission->stats();
+}
+
+node::cat_cache_stats node::get_cat_cache_stats() const
+{
+    cat_cache_stats ret;
+
+    if (!_impl->cat_cache) return ret;
+
+    auto s = _impl->cat_cache->get_stats();
+    ret.hits      = s.hits;
+    ret.misses    = s.misses;
+    ret.evictions = s.evictions;
+    ret.entries   = s.entries;
+    ret.bytes     = s.bytes;
     return ret;
 }
 
-void node::publish_( const string& cid
-                   , Timer::duration d
-                   , Cancel* cancel
-                   , std::function<void(sys::error_code)> cb)
+node::resolve_cache_stats node::get_resolve_cache_stats() const
 {
-    assert(cid.size() == CID_SIZE);
+    uint64_t s[6] = {};
+    go_asio_ipfs_resolve_cache_stats(_impl->ipfs_handle, s);
+
+    resolve_cache_stats ret;
+    ret.hits             = s[0];
+    ret.stale_hits       = s[1];
+    ret.misses           = s[2];
+    ret.refreshes        = s[3];
+    ret.refresh_failures = s[4];
+    ret.refresh_time     = std::chrono::nanoseconds(s[5]);
+    return ret;
+}
 
-    call_ipfs(_impl.get(), cancel, cb, go_asio_ipfs_publish, (char*) cid.data(), std::chrono::duration_cast<std::chrono::seconds>(d).count());
+boost::asio::io_service& node::get_io_service()
+{
+    return _impl->ios;
 }
 
-void node::resolve_( const string& node_id
-                   , Cancel* cancel
-                   , function<void(sys::error_code, string)> cb)
+node::reader::reader(node_impl* impl, uint64_t id)
+    : _impl(impl)
+    , _id(id)
+{}
+
+node::reader::reader(reader&& other)
+    : _impl(other._impl)
+    , _id(other._id)
 {
-    call_ipfs(_impl.get(), cancel, cb, go_asio_ipfs_resolve, (char*) node_id.data());
+    other._impl = nullptr;
 }
 
-void node::add_( const uint8_t* data
-               , size_t size
-               , Cancel* cancel
-               , function<void(sys::error_code, string)> cb)
+node::reader& node::reader::operator=(reader&& other)
 {
-    call_ipfs_nocancel(_impl.get(), cancel, cb, go_asio_ipfs_add, (void*) data, size, false);
+    if (this != &other) {
+        if (_impl) go_asio_ipfs_reader_free(_impl->ipfs_handle, _id);
+        _impl = other._impl;
+        _id = other._id;
+        other._impl = nullptr;
+    }
+    return *this;
 }
 
-void node::calculate_cid_( const string_view data
-                         , Cancel* cancel
-                         , function<void(sys::error_code, string)> cb)
+void node::reader::read_some_( vector<asio::mutable_buffer> buffers
+                             , Cancel* cancel
+                             , Callback<size_t> cb)
 {
-    const char* d = data.data();
-    size_t s = data.size();
-    call_ipfs_nocancel(_impl.get(), cancel, cb, go_asio_ipfs_add, (void*) d, s, true);
+    size_t max_size = asio::buffer_size(buffers);
+
+    if (max_size == 0) {
+        // Same as asio's streams: reading into an empty buffer completes
+        // immediately, without touching the underlying stream.
+        if (cancel) *cancel = []{};
+        post_handler(_impl->ios, [cb = move(cb)] () mutable { cb(sys::error_code(), 0); });
+        return;
+    }
+
+    auto cb_ = continuation<string>(_impl->handles,
+        [buffers = move(buffers), cb = move(cb)]
+        (sys::error_code ec, string chunk) mutable {
+            if (!ec && chunk.empty()) ec = asio::error::eof;
+            cb(ec, asio::buffer_copy(buffers, asio::buffer(chunk)));
+        });
+
+    call_ipfs(_impl, node::op_type::read, cancel, move(cb_), go_asio_ipfs_reader_read, _id, max_size);
 }
 
-void node::cat_( string_view cid
-               , Cancel* cancel
-               , function<void(sys::error_code, string)> cb)
+boost::asio::io_service& node::reader::get_io_service()
 {
-    assert(cid.size() == CID_SIZE);
+    return _impl->ios;
+}
 
-    call_ipfs(_impl.get(), cancel, cb, go_asio_ipfs_cat, (char*) cid.data());
+node::reader::~reader()
+{
+    if (_impl) go_asio_ipfs_reader_free(_impl->ipfs_handle, _id);
 }
 
-void node::pin_( const string& cid
-               , Cancel* cancel
-               , std::function<void(sys::error_code)> cb)
+node::writer::writer(node_impl* impl, uint64_t id)
+    : _impl(impl)
+    , _id(id)
+{}
+
+node::writer::writer(writer&& other)
+    : _impl(other._impl)
+    , _id(other._id)
 {
-    assert(cid.size() == CID_SIZE);
+    other._impl = nullptr;
+}
 
-    call_ipfs(_impl.get(), cancel, cb, go_asio_ipfs_pin, (char*) cid.data());
+node::writer& node::writer::operator=(writer&& other)
+{
+    if (this != &other) {
+        if (_impl) go_asio_ipfs_writer_free(_impl->ipfs_handle, _id);
+        _impl = other._impl;
+        _id = other._id;
+        other._impl = nullptr;
+    }
+    return *this;
 }
 
-void node::unpin_( const string& cid
-                 , Cancel* cancel
-                 , std::function<void(sys::error_code)> cb)
+// No single crossing into Go copies more than this many bytes.
+static const size_t max_write_chunk = 256 * 1024;
+
+struct WriteOp {
+    node_impl* impl;
+    uint64_t writer_id;
+    vector<asio::const_buffer> buffers;
+    size_t index = 0;
+    size_t offset = 0;
+    size_t written = 0;
+    Callback<size_t> cb;
+
+    // Chunks are started, one after another, with `cancel`. The caller's
+    // cancel function is only set once and passes cancellation on to the
+    // chunk being written, or keeps the next one from starting.
+    mutex cancel_mutex;
+    bool cancelled = false;
+    function<void()> cancel;
+
+    void abort() {
+        lock_guard<mutex> lock(cancel_mutex);
+        cancelled = true;
+        if (cancel) cancel();
+    }
+
+    static void step(shared_ptr<WriteOp> op) {
+        while (op->index < op->buffers.size()
+            && op->offset == asio::buffer_size(op->buffers[op->index])) {
+            ++op->index;
+            op->offset = 0;
+        }
+
+        if (op->index == op->buffers.size()) {
+            return op->cb(sys::error_code(), op->written);
+        }
+
+        auto& b = op->buffers[op->index];
+        auto data = asio::buffer_cast<const uint8_t*>(b) + op->offset;
+        size_t size = min(asio::buffer_size(b) - op->offset, max_write_chunk);
+
+        auto cb = continuation<>(op->impl->handles,
+            [op, size] (sys::error_code ec) mutable {
+                if (ec) return op->cb(ec, op->written);
+                op->offset  += size;
+                op->written += size;
+                step(move(op));
+            });
+
+        unique_lock<mutex> lock(op->cancel_mutex);
+
+        if (op->cancelled) {
+            lock.unlock();
+            return op->cb(asio::error::operation_aborted, op->written);
+        }
+
+        call_ipfs( op->impl, {node::op_type::write, size}, &op->cancel, move(cb)
+                 , go_asio_ipfs_writer_write, op->writer_id, (void*) data, size);
+    }
+};
+
+void node::writer::write_( vector<asio::const_buffer> buffers
+                         , Cancel* cancel
+                         , Callback<size_t> cb)
 {
-    assert(cid.size() == CID_SIZE);
+    if (asio::buffer_size(buffers) == 0) {
+        if (cancel) *cancel = []{};
+        post_handler(_impl->ios, [cb = move(cb)] () mutable { cb(sys::error_code(), 0); });
+        return;
+    }
+
+    auto op = make_shared<WriteOp>();
+    op->impl      = _impl;
+    op->writer_id = _id;
+    op->buffers   = move(buffers);
+    op->cb        = move(cb);
+
+    if (cancel) {
+        *cancel = [w = weak_ptr<WriteOp>(op)] {
+            if (auto op = w.lock()) op->abort();
+        };
+    }
 
-    call_ipfs(_impl.get(), cancel, cb, go_asio_ipfs_unpin, (char*) cid.data());
+    WriteOp::step(move(op));
 }
 
-boost::asio::io_service& node::get_io_service()
+void node::writer::finish_( Cancel* cancel
+                          , Callback<string> cb)
+{
+    call_ipfs(_impl, node::op_type::finish, cancel, move(cb), go_asio_ipfs_writer_finish, _id);
+}
+
+boost::asio::io_service& node::writer::get_io_service()
 {
     return _impl->ios;
 }
 
+node::writer::~writer()
+{
+    if (_impl) go_asio_ipfs_writer_free(_impl->ipfs_handle, _id);
+}
+
 node::~node()
 {
     if (_impl) {
-        // Make sure all handlers get completed.
-        while (!_impl->handles.empty()) {
-            auto& e = _impl->handles.front();
-            e.cancel();
-            /*
-             * The handle will unlink itself in cancel(),
-             * so there is no need to pop_front().
-             */
-        }
+        // Make sure all handlers get completed. Queued operations go
+        // first, so that aborting running ones doesn't start them.
+        _impl->admission->abort_all();
+        _impl->handles->registry.abort_all();
 
         go_asio_ipfs_free(_impl->ipfs_handle);
     }
@@ -0,0 +1,177 @@
+#include "op_stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace asio_ipfs;
+using namespace asio_ipfs::detail;
+using chrono::microseconds;
+
+// Out of line so they can be bound to references, as in C++14 they aren't
+// inline variables yet.
+const size_t node::op_type_count;
+const size_t node::latency_histogram::bucket_count;
+
+const char* node::op_type_name(op_type t)
+{
+    switch (t) {
+        case op_type::build:      return "build";
+        case op_type::add:        return "add";
+        case op_type::add_batch:  return "add_batch";
+        case op_type::add_file:   return "add_file";
+        case op_type::write:      return "write";
+        case op_type::finish:     return "finish";
+        case op_type::cat:        return "cat";
+        case op_type::cat_range:  return "cat_range";
+        case op_type::read:       return "read";
+        case op_type::resolve:    return "resolve";
+        case op_type::publish:    return "publish";
+        case op_type::pin:        return "pin";
+        case op_type::unpin:      return "unpin";
+        case op_type::pin_many:   return "pin_many";
+        case op_type::unpin_many: return "unpin_many";
+        case op_type::gc:         return "gc";
+        case op_type::connect:    return "connect";
+        case op_type::prefetch:   return "prefetch";
+        case op_type::block_put:  return "block_put";
+        case op_type::block_get:  return "block_get";
+    }
+
+    return "unknown";
+}
+
+size_t node::latency_histogram::bucket_index(microseconds d)
+{
+    uint64_t v = max<int64_t>(d.count(), 0);
+
+    // Below 8 every microsecond gets its own bucket.
+    if (v < 8) return v;
+
+    unsigned e = 63 - __builtin_clzll(v);
+
+    if (e > 31) return bucket_count - 1;
+
+    // The three bits below the leading one pick the sub-bucket.
+    return (e - 2) * 8 + ((v >> (e - 3)) & 7);
+}
+
+microseconds node::latency_histogram::lower_bound(size_t i)
+{
+    if (i < 8) return microseconds(i);
+
+    unsigned e = i / 8 + 2;
+    return microseconds(uint64_t(8 + i % 8) << (e - 3));
+}
+
+microseconds node::latency_histogram::percentile(double p) const
+{
+    if (count == 0) return microseconds(0);
+
+    uint64_t rank = max<uint64_t>(1, min<uint64_t>(count, ceil(p * count)));
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) return lower_bound(i + 1);
+    }
+
+    return lower_bound(bucket_count);
+}
+
+microseconds node::latency_histogram::mean() const
+{
+    if (count == 0) return microseconds(0);
+    return sum / count;
+}
+
+void op_recorder::Histogram::record(Clock::duration d)
+{
+    auto us = chrono::duration_cast<microseconds>(d);
+
+    buckets[node::latency_histogram::bucket_index(us)]
+        .fetch_add(1, memory_order_relaxed);
+    count.fetch_add(1, memory_order_relaxed);
+    sum.fetch_add(max<int64_t>(us.count(), 0), memory_order_relaxed);
+}
+
+void op_recorder::Histogram::add_to(node::latency_histogram& h) const
+{
+    for (size_t i = 0; i < bucket_count; ++i) {
+        h.buckets[i] += buckets[i].load(memory_order_relaxed);
+    }
+
+    h.count += count.load(memory_order_relaxed);
+    h.sum   += microseconds(sum.load(memory_order_relaxed));
+}
+
+op_recorder::Shard& op_recorder::shard()
+{
+    // Threads get spread over the shards in the order they first record.
+    static atomic<size_t> next_thread{0};
+    static thread_local size_t index = next_thread++ % shard_count;
+    return _shards[index];
+}
+
+void op_recorder::start(op_type t, size_t bytes_out)
+{
+    auto& c = shard().ops[static_cast<size_t>(t)];
+
+    c.started.fetch_add(1, memory_order_relaxed);
+    if (bytes_out) c.bytes_out.fetch_add(bytes_out, memory_order_relaxed);
+}
+
+void op_recorder::finish( op_type t
+                        , outcome o
+                        , Clock::duration latency
+                        , size_t bytes_in)
+{
+    auto& c = shard().ops[static_cast<size_t>(t)];
+
+    switch (o) {
+        case outcome::succeeded: c.succeeded.fetch_add(1, memory_order_relaxed); break;
+        case outcome::failed:    c.failed   .fetch_add(1, memory_order_relaxed); break;
+        case outcome::aborted:   c.aborted  .fetch_add(1, memory_order_relaxed); break;
+    }
+
+    if (bytes_in) c.bytes_in.fetch_add(bytes_in, memory_order_relaxed);
+
+    c.latency.record(latency);
+}
+
+void op_recorder::completion_delay(Clock::duration d)
+{
+    shard().completion_delay.record(d);
+}
+
+node::stats op_recorder::snapshot() const
+{
+    node::stats ret;
+
+    for (auto& s : _shards) {
+        for (size_t i = 0; i < node::op_type_count; ++i) {
+            auto& c = s.ops[i];
+            auto& r = ret.ops[i];
+
+            r.started   += c.started  .load(memory_order_relaxed);
+            r.succeeded += c.succeeded.load(memory_order_relaxed);
+            r.failed    += c.failed   .load(memory_order_relaxed);
+            r.aborted   += c.aborted  .load(memory_order_relaxed);
+            r.bytes_in  += c.bytes_in .load(memory_order_relaxed);
+            r.bytes_out += c.bytes_out.load(memory_order_relaxed);
+
+            c.latency.add_to(r.latency);
+        }
+
+        s.completion_delay.add_to(ret.completion_delay);
+    }
+
+    for (auto& r : ret.ops) {
+        // The counters aren't read atomically together, don't let a
+        // concurrent completion make this wrap around.
+        uint64_t done = r.succeeded + r.failed + r.aborted;
+        r.in_flight = r.started > done ? r.started - done : 0;
+    }
+
+    return ret;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <asio_ipfs/node.h>
+
+namespace asio_ipfs { namespace detail {
+
+// Per operation type counters and latency histograms. Operations complete on
+// whatever threads run the io_service, so every thread records into one of a
+// few shards of relaxed atomics and only `snapshot` sums them up.
+class op_recorder {
+public:
+    using Clock = std::chrono::steady_clock;
+    using op_type = node::op_type;
+
+    enum class outcome { succeeded, failed, aborted };
+
+    op_recorder() = default;
+
+    op_recorder(const op_recorder&) = delete;
+    op_recorder& operator=(const op_recorder&) = delete;
+
+    void start(op_type, size_t bytes_out);
+
+    void finish( op_type
+               , outcome
+               , Clock::duration latency
+               , size_t bytes_in);
+
+    void completion_delay(Clock::duration);
+
+    node::stats snapshot() const;
+
+private:
+    static const size_t shard_count = 8;
+    static const size_t bucket_count = node::latency_histogram::bucket_count;
+
+    struct Histogram {
+        std::atomic<uint64_t> buckets[bucket_count] = {};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0}; // microseconds
+
+        void record(Clock::duration);
+        void add_to(node::latency_histogram&) const;
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> started{0};
+        std::atomic<uint64_t> succeeded{0};
+        std::atomic<uint64_t> failed{0};
+        std::atomic<uint64_t> aborted{0};
+        std::atomic<uint64_t> bytes_in{0};
+        std::atomic<uint64_t> bytes_out{0};
+        Histogram latency;
+    };
+
+    struct Shard {
+        Counters ops[node::op_type_count];
+        Histogram completion_delay;
+    };
+
+    Shard& shard();
+
+private:
+    Shard _shards[shard_count];
+};
+
+}} // asio_ipfs::detail namespace
@@ -0,0 +1,195 @@
+#include "sha256.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define ASIO_IPFS_SHA_NI 1
+#  include <cpuid.h>
+#  include <immintrin.h>
+#endif
+
+using namespace asio_ipfs::detail;
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static void transform_generic(uint32_t* state, const uint8_t* data, size_t blocks)
+{
+    for (; blocks; --blocks, data += 64) {
+        uint32_t w[64];
+
+        for (int i = 0; i < 16; ++i) {
+            w[i] = uint32_t(data[4*i]) << 24 | uint32_t(data[4*i+1]) << 16
+                 | uint32_t(data[4*i+2]) << 8 | uint32_t(data[4*i+3]);
+        }
+
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+            uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+            w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + K[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t mj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + mj;
+
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#if ASIO_IPFS_SHA_NI
+__attribute__((target("sha,sse4.1")))
+static void transform_sha_ni(uint32_t* state, const uint8_t* data, size_t blocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions want the state as ABEF/CDGH instead of ABCD/EFGH.
+    __m128i tmp    = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks; --blocks, data += 64) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i w[4];
+
+        for (int g = 0; g < 16; ++g) {
+            if (g < 4) {
+                w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16*g)), MASK);
+            } else {
+                // w[g&3] holds the schedule for rounds 4g-16 .. 4g-13.
+                __m128i m = _mm_sha256msg1_epu32(w[g&3], w[(g+1)&3]);
+                m = _mm_add_epi32(m, _mm_alignr_epi8(w[(g+3)&3], w[(g+2)&3], 4));
+                w[g&3] = _mm_sha256msg2_epu32(m, w[(g+3)&3]);
+            }
+
+            __m128i msg = _mm_add_epi32(w[g&3], _mm_loadu_si128((const __m128i*) &K[4*g]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128((__m128i*) &state[0], state0);
+    _mm_storeu_si128((__m128i*) &state[4], state1);
+}
+
+static bool has_sha_ni()
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    if (!(ecx & bit_SSE4_1)) return false;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+
+    return ebx & (1u << 29);
+}
+#endif // ASIO_IPFS_SHA_NI
+
+using Transform = void(*)(uint32_t*, const uint8_t*, size_t);
+
+static Transform select_transform()
+{
+#if ASIO_IPFS_SHA_NI
+    if (has_sha_ni()) return transform_sha_ni;
+#endif
+    return transform_generic;
+}
+
+static const Transform transform = select_transform();
+
+sha256::sha256()
+    : _state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a
+            , 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 }
+{}
+
+void sha256::update(const void* data_, size_t size)
+{
+    auto data = static_cast<const uint8_t*>(data_);
+    _total_size += size;
+
+    if (_block_size) {
+        size_t n = std::min(size, sizeof(_block) - _block_size);
+        memcpy(_block + _block_size, data, n);
+        _block_size += n;
+        data += n;
+        size -= n;
+
+        if (_block_size < sizeof(_block)) return;
+
+        transform(_state, _block, 1);
+        _block_size = 0;
+    }
+
+    if (size >= 64) {
+        transform(_state, data, size / 64);
+        data += size & ~size_t(63);
+        size &= 63;
+    }
+
+    memcpy(_block, data, size);
+    _block_size = size;
+}
+
+sha256::digest sha256::finish()
+{
+    uint64_t bits = _total_size * 8;
+
+    uint8_t pad[72] = { 0x80 };
+    size_t pad_size = (_block_size < 56 ? 56 : 120) - _block_size;
+
+    for (int i = 0; i < 8; ++i) {
+        pad[pad_size + i] = uint8_t(bits >> (56 - 8*i));
+    }
+
+    update(pad, pad_size + 8);
+
+    digest ret;
+
+    for (int i = 0; i < 8; ++i) {
+        ret[4*i]   = uint8_t(_state[i] >> 24);
+        ret[4*i+1] = uint8_t(_state[i] >> 16);
+        ret[4*i+2] = uint8_t(_state[i] >> 8);
+        ret[4*i+3] = uint8_t(_state[i]);
+    }
+
+    return ret;
+}
+
+sha256::digest sha256::hash(const void* data, size_t size)
+{
+    sha256 h;
+    h.update(data, size);
+    return h.finish();
+}
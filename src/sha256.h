@@ -0,0 +1,28 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace asio_ipfs { namespace detail {
+
+// Incremental SHA-256. Uses the x86 SHA extensions when the CPU has them.
+class sha256 {
+public:
+    using digest = std::array<uint8_t, 32>;
+
+    sha256();
+
+    void update(const void* data, size_t size);
+    digest finish();
+
+    static digest hash(const void* data, size_t size);
+
+private:
+    uint32_t _state[8];
+    uint8_t  _block[64];
+    size_t   _block_size = 0;
+    uint64_t _total_size = 0;
+};
+
+}} // asio_ipfs::detail namespace
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// A new temporary directory for a node's repository, removed together with
+// everything in it when this goes out of scope.
+class temp_repo {
+public:
+    temp_repo() {
+        char path[] = "/tmp/asio-ipfs-test-XXXXXX";
+
+        if (!mkdtemp(path)) {
+            throw std::runtime_error("Failed to create a temporary repository");
+        }
+
+        _path = path;
+    }
+
+    temp_repo(const temp_repo&) = delete;
+    temp_repo& operator=(const temp_repo&) = delete;
+
+    ~temp_repo() {
+        nftw(_path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    const std::string& path() const { return _path; }
+
+private:
+    static int remove_entry(const char* path, const struct stat*, int, struct FTW*) {
+        return ::remove(path);
+    }
+
+private:
+    std::string _path;
+};
@@ -0,0 +1,203 @@
+// Deadlines and admission control. The node is online but has no peers, so
+// fetching content it doesn't have never finishes on its own: such `cat`s
+// hold on to their admission slot until their deadline passes.
+
+#define BOOST_TEST_MODULE admission
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using std::vector;
+using asio_ipfs::node;
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+static node::config peerless_config()
+{
+    node::config cfg;
+    cfg.identity  = node::identity_type::ed25519;
+    cfg.bootstrap = false;
+    cfg.http_api  = false;
+    cfg.max_interactive = 1;
+    cfg.max_background  = 1;
+    cfg.max_queued      = 1;
+    return cfg;
+}
+
+static node::call_options timeout(Clock::duration d)
+{
+    node::call_options o;
+    o.timeout = d;
+    return o;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), peerless_config()};
+
+    // Valid CIDs of content nobody has.
+    const string missing1 = asio_ipfs::calculate_cid("admission test 1");
+    const string missing2 = asio_ipfs::calculate_cid("admission test 2");
+    const string missing3 = asio_ipfs::calculate_cid("admission test 3");
+
+    // The order in which handlers got called.
+    vector<string> order;
+
+    void cat(const string& name, const string& cid, node::call_options o, sys::error_code& result) {
+        n.cat(cid, o, [this, name, &result] (sys::error_code ec, string) {
+                order.push_back(name);
+                result = ec;
+            });
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(admission, fixture)
+
+BOOST_AUTO_TEST_CASE(deadline)
+{
+    sys::error_code result;
+    auto start = Clock::now();
+
+    cat("cat", missing1, timeout(milliseconds(200)), result);
+    ios.run();
+
+    auto took = Clock::now() - start;
+
+    BOOST_CHECK_EQUAL(result, asio::error::timed_out);
+    BOOST_CHECK(took >= milliseconds(200));
+    BOOST_CHECK(took < std::chrono::seconds(10));
+}
+
+BOOST_AUTO_TEST_CASE(queue_full)
+{
+    sys::error_code running, queued, rejected;
+
+    cat("running",  missing1, timeout(milliseconds(1000)), running);
+    cat("queued",   missing2, timeout(milliseconds(300)),  queued);
+    cat("rejected", missing3, timeout(milliseconds(1000)), rejected);
+
+    auto s = n.get_admission_stats().interactive;
+    BOOST_CHECK_EQUAL(s.limit, 1u);
+    BOOST_CHECK_EQUAL(s.running, 1u);
+    BOOST_CHECK_EQUAL(s.queued, 1u);
+
+    ios.run();
+
+    // Turned away right away, and the queued one expires while the first
+    // one still runs.
+    BOOST_REQUIRE_EQUAL(order.size(), 3u);
+    BOOST_CHECK_EQUAL(order[0], "rejected");
+    BOOST_CHECK_EQUAL(order[1], "queued");
+    BOOST_CHECK_EQUAL(order[2], "running");
+
+    BOOST_CHECK_EQUAL(rejected, asio_ipfs::error::overloaded);
+    BOOST_CHECK_EQUAL(queued, asio::error::timed_out);
+    BOOST_CHECK_EQUAL(running, asio::error::timed_out);
+
+    s = n.get_admission_stats().interactive;
+    BOOST_CHECK_EQUAL(s.running, 0u);
+    BOOST_CHECK_EQUAL(s.queued, 0u);
+    BOOST_CHECK_EQUAL(s.admitted, 1u);
+    BOOST_CHECK_EQUAL(s.rejected, 1u);
+    BOOST_CHECK_EQUAL(s.expired, 1u);
+    BOOST_CHECK_EQUAL(s.wait.count, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(cancel_queued)
+{
+    sys::error_code running, queued;
+    std::function<void()> cancel;
+
+    cat("running", missing1, timeout(milliseconds(500)), running);
+
+    n.cat(missing2, timeout(milliseconds(5000)), cancel,
+        [&] (sys::error_code ec, string) {
+            order.push_back("queued");
+            queued = ec;
+        });
+
+    cancel();
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(order.size(), 2u);
+    BOOST_CHECK_EQUAL(order[0], "queued");
+    BOOST_CHECK_EQUAL(queued, asio::error::operation_aborted);
+    BOOST_CHECK_EQUAL(running, asio::error::timed_out);
+    BOOST_CHECK_EQUAL(n.get_admission_stats().interactive.queued, 0u);
+}
+
+// Once the running one is done, the queued one gets its slot.
+BOOST_AUTO_TEST_CASE(queued_starts)
+{
+    sys::error_code running, queued;
+    std::function<void()> cancel;
+
+    cat("running", missing1, timeout(milliseconds(200)), running);
+
+    n.cat(missing2, timeout(milliseconds(5000)), cancel,
+        [&] (sys::error_code ec, string) {
+            order.push_back("queued");
+            queued = ec;
+        });
+
+    // By then the second one runs, cancelling it now cancels the operation.
+    asio::steady_timer timer(ios, milliseconds(1000));
+    timer.async_wait([&] (sys::error_code) {
+            auto s = n.get_admission_stats().interactive;
+            BOOST_CHECK_EQUAL(s.running, 1u);
+            BOOST_CHECK_EQUAL(s.queued, 0u);
+            cancel();
+        });
+
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(order.size(), 2u);
+    BOOST_CHECK_EQUAL(order[0], "running");
+    BOOST_CHECK_EQUAL(running, asio::error::timed_out);
+    BOOST_CHECK_EQUAL(queued, asio::error::operation_aborted);
+
+    auto s = n.get_admission_stats().interactive;
+    BOOST_CHECK_EQUAL(s.admitted, 2u);
+    BOOST_CHECK_EQUAL(s.expired, 0u);
+    BOOST_CHECK_EQUAL(s.wait.count, 2u);
+    BOOST_CHECK(s.wait.percentile(1) >= milliseconds(150));
+}
+
+// Interactive and background operations don't wait for each other.
+BOOST_AUTO_TEST_CASE(classes_independent)
+{
+    string cid;
+
+    n.add("admission test", [&] (sys::error_code ec, string c) {
+            BOOST_REQUIRE(!ec);
+            cid = std::move(c);
+        });
+
+    ios.run();
+    ios.reset();
+
+    sys::error_code running, pinned;
+
+    cat("cat", missing1, timeout(milliseconds(1000)), running);
+
+    n.pin(cid, node::call_options(), [&] (sys::error_code ec) {
+            order.push_back("pin");
+            pinned = ec;
+        });
+
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(order.size(), 2u);
+    BOOST_CHECK_EQUAL(order[0], "pin");
+    BOOST_CHECK(!pinned);
+    BOOST_CHECK_EQUAL(n.get_admission_stats().background.admitted, 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,165 @@
+// Heap allocations made by the C++ side of an operation once a node has
+// warmed up. Only allocations on the thread running the io_service are
+// counted, those are where operations get started and completed; the Go
+// side allocates from its own heap.
+
+#define BOOST_TEST_MODULE allocations
+#include <boost/test/included/unit_test.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using std::vector;
+using asio_ipfs::node;
+
+static thread_local bool t_counting = false;
+static size_t g_allocations = 0;
+
+void* operator new(size_t size)
+{
+    if (t_counting) ++g_allocations;
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// What an operation's completion state takes from its handler's allocator.
+static std::atomic<size_t> g_handler_allocations{0};
+static std::atomic<size_t> g_handler_deallocations{0};
+
+template<class T>
+struct counting_allocator {
+    using value_type = T;
+
+    counting_allocator() = default;
+    template<class U> counting_allocator(const counting_allocator<U>&) {}
+
+    T* allocate(size_t n) {
+        ++g_handler_allocations;
+        return static_cast<T*>(std::malloc(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t) {
+        ++g_handler_deallocations;
+        std::free(p);
+    }
+
+    template<class U> bool operator==(const counting_allocator<U>&) const { return true; }
+    template<class U> bool operator!=(const counting_allocator<U>&) const { return false; }
+};
+
+// Starts `ops` operations one after another, each from the completion of
+// the previous one, and records how many allocations each of them made.
+template<class Start>
+struct loop {
+    using allocator_type = counting_allocator<char>;
+    allocator_type get_allocator() const noexcept { return {}; }
+
+    Start start;
+    size_t left;
+    vector<size_t>* counts;
+    sys::error_code* error;
+    size_t mark = 0;
+    bool started = false;
+
+    void operator()(sys::error_code ec, string = string()) {
+        if (started) counts->push_back(g_allocations - mark);
+        if (ec) *error = ec;
+        if (ec || left-- == 0) return;
+        mark = g_allocations;
+        started = true;
+        start(std::move(*this));
+    }
+};
+
+template<class Start>
+static vector<size_t> run_loop(asio::io_service& ios, size_t ops, Start start)
+{
+    vector<size_t> counts;
+    counts.reserve(ops);
+    sys::error_code error;
+
+    g_handler_allocations = g_handler_deallocations = 0;
+
+    t_counting = true;
+    loop<Start>{start, ops, &counts, &error}(sys::error_code());
+    ios.run();
+    ios.reset();
+    t_counting = false;
+
+    BOOST_REQUIRE(!error);
+    BOOST_REQUIRE_EQUAL(counts.size(), ops);
+
+    return counts;
+}
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+// Once the handle pool and SingleFlight have what they need, operations
+// allocate nothing but their completion state, which comes from the
+// handler's allocator.
+static void check_steady(const vector<size_t>& counts)
+{
+    const size_t warm_up = 10;
+
+    for (size_t i = warm_up; i < counts.size(); ++i) {
+        BOOST_REQUIRE_MESSAGE(counts[i] == 0, "operation " << i << " allocated "
+                                              << counts[i] << " times");
+    }
+
+#if BOOST_VERSION >= 107000
+    // One completion state per operation, all of it given back.
+    BOOST_CHECK_EQUAL(g_handler_allocations, counts.size());
+    BOOST_CHECK_EQUAL(g_handler_deallocations, g_handler_allocations);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(steady_state_add)
+{
+    temp_repo repo;
+    asio::io_service ios;
+    node n(ios, repo.path(), offline_config());
+
+    const string data = "steady state add";
+
+    auto counts = run_loop(ios, 200, [&] (auto&& h) { n.add(data, std::move(h)); });
+
+    check_steady(counts);
+}
+
+BOOST_AUTO_TEST_CASE(steady_state_cat)
+{
+    temp_repo repo;
+    asio::io_service ios;
+    node n(ios, repo.path(), offline_config());
+
+    string cid;
+
+    n.add("steady state cat", [&] (sys::error_code ec, string c) {
+            BOOST_REQUIRE(!ec);
+            cid = std::move(c);
+        });
+
+    ios.run();
+    ios.reset();
+
+    auto counts = run_loop(ios, 200, [&] (auto&& h) { n.cat(cid, std::move(h)); });
+
+    check_steady(counts);
+}
@@ -0,0 +1,249 @@
+// Raw blocks put and got straight into the caller's buffers. Buffers are
+// filled with a marker beforehand to tell whether anything got written.
+
+#define BOOST_TEST_MODULE blocks
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using std::vector;
+using asio_ipfs::node;
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+static sys::error_code ipfs_error(int n)
+{
+    return asio_ipfs::error::make_error_code(asio_ipfs::error::ipfs_error{n});
+}
+
+static bool untouched(const string& buffer)
+{
+    return buffer.find_first_not_of('#') == string::npos;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    vector<string> put_many(const vector<string>& datas, node::block_codec codec) {
+        vector<asio::const_buffer> buffers;
+        for (auto& d : datas) buffers.push_back(asio::buffer(d));
+
+        vector<string> ret;
+
+        n.block_put_many(buffers, codec, [&] (sys::error_code ec, vector<string> cids) {
+                BOOST_REQUIRE_MESSAGE(!ec, "block_put_many: " << ec.message());
+                ret = std::move(cids);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    string put(const string& data, node::block_codec codec) {
+        string ret;
+
+        n.block_put(asio::buffer(data), codec, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "block_put: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code get(const string& cid, string& buffer, size_t& size) {
+        sys::error_code ret;
+
+        n.block_get(cid, asio::buffer(&buffer[0], buffer.size()),
+            [&] (sys::error_code ec, size_t s) {
+                ret = ec;
+                size = s;
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code get_many( const vector<string>& cids
+                            , vector<string>& buffers
+                            , vector<size_t>& sizes) {
+        vector<asio::mutable_buffer> bs;
+        for (auto& b : buffers) bs.push_back(asio::buffer(&b[0], b.size()));
+
+        sys::error_code ret;
+
+        n.block_get_many(cids, bs, [&] (sys::error_code ec, vector<size_t> s) {
+                ret = ec;
+                sizes = std::move(s);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(blocks, fixture)
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+    const string data = "block test";
+    vector<string> cids;
+
+    for (auto codec : { node::block_codec::raw
+                      , node::block_codec::dag_pb
+                      , node::block_codec::dag_cbor }) {
+        string cid = put(data, codec);
+        string buffer(64, '#');
+        size_t size = 0;
+
+        BOOST_REQUIRE(!get(cid, buffer, size));
+        BOOST_CHECK_EQUAL(size, data.size());
+        BOOST_CHECK_EQUAL(buffer.substr(0, size), data);
+        // Nothing past the block.
+        BOOST_CHECK(untouched(buffer.substr(size)));
+
+        cids.push_back(cid);
+    }
+
+    // The codec is part of the CID.
+    BOOST_CHECK_NE(cids[0], cids[1]);
+    BOOST_CHECK_NE(cids[0], cids[2]);
+    BOOST_CHECK_NE(cids[1], cids[2]);
+}
+
+BOOST_AUTO_TEST_CASE(exact_fit)
+{
+    const string data = "block exact fit test";
+    string cid = put(data, node::block_codec::raw);
+    string buffer(data.size(), '#');
+    size_t size = 0;
+
+    BOOST_REQUIRE(!get(cid, buffer, size));
+    BOOST_CHECK_EQUAL(buffer, data);
+}
+
+BOOST_AUTO_TEST_CASE(buffer_too_small)
+{
+    const string data = "block too small test";
+    string cid = put(data, node::block_codec::raw);
+    string buffer(data.size() - 1, '#');
+    size_t size = 0;
+
+    BOOST_CHECK_EQUAL(get(cid, buffer, size), ipfs_error(IPFS_BUFFER_TOO_SMALL));
+    BOOST_CHECK(untouched(buffer));
+}
+
+BOOST_AUTO_TEST_CASE(missing)
+{
+    string cid = asio_ipfs::calculate_cid("block missing test, never added");
+
+    string buffer(64, '#');
+    size_t size = 0;
+
+    BOOST_CHECK(get(cid, buffer, size));
+    BOOST_CHECK(untouched(buffer));
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::block_get].failed, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(many)
+{
+    const vector<string> datas{"block one", "block two, longer", "3"};
+    vector<string> cids = put_many(datas, node::block_codec::raw);
+
+    BOOST_REQUIRE_EQUAL(cids.size(), datas.size());
+
+    // Same order as the buffers given.
+    for (size_t i = 0; i < datas.size(); ++i) {
+        BOOST_CHECK_EQUAL(cids[i], put(datas[i], node::block_codec::raw));
+    }
+
+    // Asking for one block twice gets it into both buffers.
+    cids.push_back(cids[0]);
+
+    vector<string> buffers(cids.size(), string(32, '#'));
+    vector<size_t> sizes;
+
+    BOOST_REQUIRE(!get_many(cids, buffers, sizes));
+    BOOST_REQUIRE_EQUAL(sizes.size(), cids.size());
+
+    for (size_t i = 0; i < cids.size(); ++i) {
+        const string& data = datas[i % datas.size()];
+        BOOST_CHECK_EQUAL(sizes[i], data.size());
+        BOOST_CHECK_EQUAL(buffers[i].substr(0, sizes[i]), data);
+    }
+}
+
+// One block not fitting its buffer fails the lot, without writing any.
+BOOST_AUTO_TEST_CASE(many_too_small)
+{
+    const vector<string> datas{"block one", "block two, longer"};
+    vector<string> cids = put_many(datas, node::block_codec::raw);
+
+    vector<string> buffers{string(32, '#'), string(4, '#')};
+    vector<size_t> sizes;
+
+    BOOST_CHECK_EQUAL(get_many(cids, buffers, sizes), ipfs_error(IPFS_BUFFER_TOO_SMALL));
+    BOOST_CHECK(untouched(buffers[0]));
+    BOOST_CHECK(untouched(buffers[1]));
+}
+
+BOOST_AUTO_TEST_CASE(many_mismatched)
+{
+    vector<string> cids{put("block mismatched test", node::block_codec::raw)};
+    vector<string> buffers;
+    vector<size_t> sizes;
+
+    BOOST_CHECK_EQUAL(get_many(cids, buffers, sizes), asio::error::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Online but without peers, getting a missing block waits until cancelled,
+// after which the buffer belongs to the caller again.
+BOOST_AUTO_TEST_CASE(cancel)
+{
+    temp_repo repo;
+    asio::io_service ios;
+
+    node::config cfg;
+    cfg.identity  = node::identity_type::ed25519;
+    cfg.bootstrap = false;
+    cfg.http_api  = false;
+
+    node n(ios, repo.path(), cfg);
+
+    string cid = asio_ipfs::calculate_cid("block cancel test, never added");
+    string buffer(64, '#');
+    std::function<void()> cancel;
+    sys::error_code result;
+
+    n.block_get(cid, asio::buffer(&buffer[0], buffer.size()), cancel,
+        [&] (sys::error_code ec, size_t) { result = ec; });
+
+    asio::steady_timer timer(ios, std::chrono::milliseconds(200));
+    timer.async_wait([&] (sys::error_code) { cancel(); });
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(result, asio::error::operation_aborted);
+    BOOST_CHECK(untouched(buffer));
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::block_get].aborted, 1u);
+}
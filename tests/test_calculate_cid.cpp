@@ -0,0 +1,137 @@
+// `calculate_cid` against the CIDs go-ipfs' importer gives the same content
+// with `node::add` and default options, from inputs smaller than a chunk to
+// ones whose DAG needs a second level of links.
+
+#define BOOST_TEST_MODULE calculate_cid
+#include <boost/test/included/unit_test.hpp>
+
+#include <random>
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using asio_ipfs::node;
+
+static const size_t chunk_size = 256 * 1024;
+// Links per node of the balanced layout.
+static const size_t max_links = 174;
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+static string random_data(size_t size)
+{
+    std::mt19937 rng(size);
+    string ret(size, '\0');
+    for (auto& c : ret) c = char(rng());
+    return ret;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    string add(const string& data) {
+        string ret;
+
+        n.add(data, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    string node_calculate_cid(const string& data) {
+        string ret;
+        std::function<void()> cancel;
+
+        n.calculate_cid(data, cancel, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE(!ec);
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    void check(const string& data) {
+        BOOST_TEST_MESSAGE("size " << data.size());
+
+        string expected = add(data);
+
+        BOOST_CHECK_EQUAL(asio_ipfs::calculate_cid(data), expected);
+        BOOST_CHECK_EQUAL(node_calculate_cid(data), expected);
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(against_add, fixture)
+
+BOOST_AUTO_TEST_CASE(known_cids)
+{
+    BOOST_CHECK_EQUAL( asio_ipfs::calculate_cid("")
+                     , "QmbFMke1KXqnYyBBWxB74N4c5SBnJMVAiMNRcGu6x1AwQH");
+
+    BOOST_CHECK_EQUAL( asio_ipfs::calculate_cid("hello world\n")
+                     , "QmT78zSuBmuS4z925WZfrqQ1qHaJ56DQaTfyMUF7F8ff5o");
+}
+
+BOOST_AUTO_TEST_CASE(single_chunk)
+{
+    check("");
+    check("hello world\n");
+    check(random_data(chunk_size - 1));
+    check(random_data(chunk_size));
+}
+
+BOOST_AUTO_TEST_CASE(several_chunks)
+{
+    check(random_data(chunk_size + 1));
+    check(random_data(3 * 1024 * 1024 + 12345));
+    check(random_data(max_links * chunk_size));
+}
+
+BOOST_AUTO_TEST_CASE(two_levels)
+{
+    check(random_data(max_links * chunk_size + 1));
+}
+
+// Big inputs are hashed outside of the io_service, which meanwhile runs
+// other handlers.
+BOOST_AUTO_TEST_CASE(big_input_off_the_io_service)
+{
+    const string data = random_data(64 * 1024 * 1024);
+    std::vector<string> order;
+    string cid;
+    std::function<void()> cancel;
+
+    n.calculate_cid(data, cancel, [&] (sys::error_code ec, string c) {
+            BOOST_REQUIRE(!ec);
+            order.push_back("cid");
+            cid = std::move(c);
+        });
+
+    ios.post([&] { order.push_back("other"); });
+
+    ios.run();
+    ios.reset();
+
+    BOOST_REQUIRE_EQUAL(order.size(), 2u);
+    BOOST_CHECK_EQUAL(order[0], "other");
+    BOOST_CHECK_EQUAL(cid, asio_ipfs::calculate_cid(data));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,224 @@
+// Completion handlers and tokens other than plain callbacks: move-only
+// handlers, handlers with an executor of their own, `use_awaitable` and
+// cancellation slots. Each needs a Boost version recent enough for it.
+
+#define BOOST_TEST_MODULE completion
+#include <boost/test/included/unit_test.hpp>
+
+#include <memory>
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include <boost/version.hpp>
+#include "temp_repo.h"
+
+#if BOOST_VERSION >= 107000
+#include <boost/asio/bind_executor.hpp>
+#endif
+
+#ifdef BOOST_ASIO_HAS_CO_AWAIT
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#endif
+
+#if BOOST_VERSION >= 107700
+#include <boost/asio/bind_cancellation_slot.hpp>
+#include <boost/asio/cancellation_signal.hpp>
+#endif
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using asio_ipfs::node;
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    const string data = "completion test";
+
+    string add() {
+        string ret;
+
+        n.add(data, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(completion, fixture)
+
+BOOST_AUTO_TEST_CASE(called_once)
+{
+    string cid = add();
+    size_t calls = 0;
+    string got;
+
+    n.cat(cid, [&] (sys::error_code ec, string d) {
+            BOOST_REQUIRE_MESSAGE(!ec, "cat: " << ec.message());
+            ++calls;
+            got = std::move(d);
+        });
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(calls, 1u);
+    BOOST_CHECK_EQUAL(got, data);
+}
+
+#if BOOST_VERSION >= 107000
+
+BOOST_AUTO_TEST_CASE(move_only_handler)
+{
+    string cid = add();
+    string got;
+
+    n.cat(cid, [&got, p = std::make_unique<int>()] (sys::error_code ec, string d) {
+            BOOST_REQUIRE_MESSAGE(!ec, "cat: " << ec.message());
+            BOOST_REQUIRE(p);
+            got = std::move(d);
+        });
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(got, data);
+}
+
+// The handler is called through its associated executor, here that of an
+// io_service other than the node's.
+BOOST_AUTO_TEST_CASE(associated_executor)
+{
+    asio::io_service other;
+    bool called = false;
+
+    n.add(data, asio::bind_executor(other,
+        [&] (sys::error_code ec, string) {
+            BOOST_CHECK(!ec);
+            BOOST_CHECK(other.get_executor().running_in_this_thread());
+            called = true;
+        }));
+
+    ios.run();
+    BOOST_CHECK(!called);
+
+    other.run();
+    BOOST_CHECK(called);
+}
+
+#endif // BOOST_VERSION >= 107000
+
+#ifdef BOOST_ASIO_HAS_CO_AWAIT
+
+BOOST_AUTO_TEST_CASE(awaitable)
+{
+    string got;
+
+    asio::co_spawn(ios, [&] () -> asio::awaitable<void> {
+            string cid = co_await n.add(data, asio::use_awaitable);
+            got = co_await n.cat(cid, asio::use_awaitable);
+        }, asio::detached);
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(got, data);
+}
+
+BOOST_AUTO_TEST_CASE(awaitable_error)
+{
+    sys::error_code error;
+
+    asio::co_spawn(ios, [&] () -> asio::awaitable<void> {
+            // More CIDs than buffers.
+            std::vector<string> cids{"a"};
+            std::vector<asio::mutable_buffer> buffers;
+
+            try {
+                co_await n.block_get_many(cids, buffers, asio::use_awaitable);
+            }
+            catch (const sys::system_error& e) {
+                error = e.code();
+            }
+        }, asio::detached);
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(error, asio::error::invalid_argument);
+}
+
+#endif // BOOST_ASIO_HAS_CO_AWAIT
+
+#if BOOST_VERSION >= 107700
+
+// Emitting the slot's signal cancels the operation, also without a cancel
+// function of the caller's.
+BOOST_AUTO_TEST_CASE(cancellation_slot)
+{
+    string cid = add();
+    asio::cancellation_signal signal;
+    sys::error_code result;
+
+    n.cat(cid, asio::bind_cancellation_slot(signal.slot(),
+        [&] (sys::error_code ec, string) { result = ec; }));
+
+    // The io_service hasn't run yet, so the cat can't have completed.
+    signal.emit(asio::cancellation_type::terminal);
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(result, asio::error::operation_aborted);
+}
+
+BOOST_AUTO_TEST_CASE(cancellation_slot_with_cancel)
+{
+    string cid = add();
+    asio::cancellation_signal signal;
+    std::function<void()> cancel;
+    sys::error_code result;
+
+    n.cat(cid, cancel, asio::bind_cancellation_slot(signal.slot(),
+        [&] (sys::error_code ec, string) { result = ec; }));
+
+    signal.emit(asio::cancellation_type::terminal);
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(result, asio::error::operation_aborted);
+}
+
+// Once the operation has completed the slot is free again.
+BOOST_AUTO_TEST_CASE(cancellation_slot_cleared)
+{
+    string cid = add();
+    asio::cancellation_signal signal;
+    string got;
+
+    n.cat(cid, asio::bind_cancellation_slot(signal.slot(),
+        [&] (sys::error_code ec, string d) {
+            BOOST_REQUIRE(!ec);
+            got = std::move(d);
+        }));
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(got, data);
+    BOOST_CHECK(!signal.slot().has_handler());
+}
+
+#endif // BOOST_VERSION >= 107700
+
+BOOST_AUTO_TEST_SUITE_END()
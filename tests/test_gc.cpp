@@ -0,0 +1,254 @@
+// Incremental garbage collection. Content added with `add` isn't pinned, so
+// it's garbage right away. Offline, whether the node still has content is
+// told by whether `cat`ing it succeeds.
+
+#define BOOST_TEST_MODULE gc
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using std::vector;
+using asio_ipfs::node;
+
+static const size_t chunk_size = 256 * 1024;
+
+// Content whose chunks all differ, so none of its blocks are deduplicated.
+static string distinct_data(size_t size)
+{
+    string ret;
+    for (size_t i = 0; ret.size() < size; ++i) ret += std::to_string(i) + ' ';
+    ret.resize(size);
+    return ret;
+}
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+static node::gc_budget unlimited()
+{
+    node::gc_budget b;
+    b.time = std::chrono::nanoseconds(0);
+    return b;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    fixture() {
+        // Whatever a new repository comes with that isn't pinned.
+        drain();
+    }
+
+    string add(const string& data) {
+        string ret;
+
+        n.add(data, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    bool has(const string& cid) {
+        sys::error_code ret;
+
+        n.cat(cid, [&] (sys::error_code ec, string) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return !ret;
+    }
+
+    sys::error_code pin(const string& cid) {
+        sys::error_code ret;
+
+        n.pin(cid, [&] (sys::error_code ec) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code unpin(const string& cid) {
+        sys::error_code ret;
+
+        n.unpin(cid, [&] (sys::error_code ec) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    node::gc_result gc(node::gc_budget budget) {
+        node::gc_result ret;
+
+        n.gc(budget, [&] (sys::error_code ec, node::gc_result r) {
+                BOOST_REQUIRE_MESSAGE(!ec, "gc: " << ec.message());
+                ret = r;
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    // Runs passes to completion, returning the sum of what they removed.
+    node::gc_result drain(node::gc_budget budget = unlimited()) {
+        node::gc_result ret;
+
+        for (size_t i = 0; i < 10000 && !ret.complete; ++i) {
+            auto r = gc(budget);
+            ret.blocks_removed += r.blocks_removed;
+            ret.bytes_freed    += r.bytes_freed;
+            ret.duration       += r.duration;
+            ret.complete        = r.complete;
+        }
+
+        BOOST_REQUIRE(ret.complete);
+        return ret;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(gc, fixture)
+
+BOOST_AUTO_TEST_CASE(nothing_to_collect)
+{
+    auto r = gc(unlimited());
+
+    BOOST_CHECK(r.complete);
+    BOOST_CHECK_EQUAL(r.blocks_removed, 0u);
+    BOOST_CHECK_EQUAL(r.bytes_freed, 0u);
+}
+
+// A root and three leaves.
+BOOST_AUTO_TEST_CASE(removes_unpinned)
+{
+    const string data = distinct_data(3 * chunk_size);
+    string cid = add(data);
+
+    BOOST_REQUIRE(has(cid));
+
+    auto r = gc(unlimited());
+
+    BOOST_CHECK(r.complete);
+    BOOST_CHECK_EQUAL(r.blocks_removed, 4u);
+    BOOST_CHECK_GE(r.bytes_freed, data.size());
+    BOOST_CHECK_GT(r.duration.count(), 0);
+
+    BOOST_CHECK(!has(cid));
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::gc].succeeded, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(keeps_pinned)
+{
+    string pinned   = add("gc pinned test");
+    string unpinned = add("gc unpinned test");
+
+    BOOST_REQUIRE(!pin(pinned));
+
+    auto r = drain();
+
+    BOOST_CHECK_EQUAL(r.blocks_removed, 1u);
+    BOOST_CHECK(has(pinned));
+    BOOST_CHECK(!has(unpinned));
+
+    BOOST_REQUIRE(!unpin(pinned));
+
+    r = drain();
+
+    BOOST_CHECK_EQUAL(r.blocks_removed, 1u);
+    BOOST_CHECK(!has(pinned));
+}
+
+// A block budget ends a call early, and the next ones carry on with the
+// same pass until it completes.
+BOOST_AUTO_TEST_CASE(block_budget)
+{
+    const size_t count = 200;
+    vector<string> cids;
+
+    for (size_t i = 0; i < count; ++i) {
+        cids.push_back(add("gc budget test " + std::to_string(i)));
+    }
+
+    node::gc_budget budget = unlimited();
+    budget.blocks = 1;
+
+    auto first = gc(budget);
+
+    BOOST_CHECK(!first.complete);
+    BOOST_CHECK_GE(first.blocks_removed, 1u);
+    BOOST_CHECK_LT(first.blocks_removed, count);
+
+    auto rest = drain(budget);
+
+    BOOST_CHECK_EQUAL(first.blocks_removed + rest.blocks_removed, count);
+
+    for (auto& cid : cids) BOOST_REQUIRE(!has(cid));
+}
+
+// Marking isn't bounded by the budget, but removing blocks is.
+BOOST_AUTO_TEST_CASE(time_budget)
+{
+    string cid = add("gc time budget test");
+
+    node::gc_budget budget;
+    budget.time = std::chrono::nanoseconds(1);
+
+    auto r = gc(budget);
+
+    BOOST_CHECK(!r.complete);
+    BOOST_CHECK_EQUAL(r.blocks_removed, 0u);
+    BOOST_CHECK(has(cid));
+
+    r = drain();
+
+    BOOST_CHECK_EQUAL(r.blocks_removed, 1u);
+    BOOST_CHECK(!has(cid));
+}
+
+// Pinning something in the middle of a pass keeps it from being removed
+// by the rest of that pass.
+BOOST_AUTO_TEST_CASE(pin_during_pass)
+{
+    const size_t count = 200;
+    vector<string> cids;
+
+    for (size_t i = 0; i < count; ++i) {
+        cids.push_back(add("gc pin during pass test " + std::to_string(i)));
+    }
+
+    node::gc_budget budget = unlimited();
+    budget.blocks = 1;
+
+    BOOST_REQUIRE(!gc(budget).complete);
+
+    vector<string> left;
+    for (auto& cid : cids) if (has(cid)) left.push_back(cid);
+
+    BOOST_REQUIRE(!left.empty());
+    BOOST_REQUIRE(!pin(left.front()));
+
+    drain();
+
+    BOOST_CHECK(has(left.front()));
+    for (size_t i = 1; i < left.size(); ++i) BOOST_CHECK(!has(left[i]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+// Nodes started on repositories created with each of the identity types.
+
+#define BOOST_TEST_MODULE identity
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using asio_ipfs::node;
+
+static node::config offline_config(node::identity_type identity)
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    cfg.identity = identity;
+    return cfg;
+}
+
+static bool starts_with(const string& s, const string& prefix)
+{
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+// The node serves content it has added.
+static void check_usable(asio::io_service& ios, node& n)
+{
+    const string data = "identity test";
+    string cid, got;
+
+    n.add(data, [&] (sys::error_code ec, string c) {
+            BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+            cid = std::move(c);
+
+            n.cat(cid, [&] (sys::error_code ec, string d) {
+                    BOOST_REQUIRE_MESSAGE(!ec, "cat: " << ec.message());
+                    got = std::move(d);
+                });
+        });
+
+    ios.run();
+    ios.reset();
+
+    BOOST_CHECK_EQUAL(got, data);
+}
+
+BOOST_AUTO_TEST_CASE(ed25519)
+{
+    temp_repo repo;
+    asio::io_service ios;
+    node n(ios, repo.path(), offline_config(node::identity_type::ed25519));
+
+    // Ed25519 keys are small enough to be inlined into the peer id.
+    BOOST_CHECK_MESSAGE(starts_with(n.id(), "12D3KooW"), "id " << n.id());
+
+    check_usable(ios, n);
+}
+
+BOOST_AUTO_TEST_CASE(ed25519_build)
+{
+    temp_repo repo;
+    asio::io_service ios;
+    std::unique_ptr<node> n;
+
+    node::build(ios, repo.path(), offline_config(node::identity_type::ed25519),
+        [&] (sys::error_code ec, std::unique_ptr<node> n_) {
+            BOOST_REQUIRE_MESSAGE(!ec, "build: " << ec.message());
+            n = std::move(n_);
+        });
+
+    ios.run();
+    ios.reset();
+
+    BOOST_REQUIRE(n);
+    BOOST_CHECK_MESSAGE(starts_with(n->id(), "12D3KooW"), "id " << n->id());
+
+    check_usable(ios, *n);
+}
+
+BOOST_AUTO_TEST_CASE(rsa)
+{
+    temp_repo repo;
+    asio::io_service ios;
+    node n(ios, repo.path(), offline_config(node::identity_type::rsa));
+
+    BOOST_CHECK_MESSAGE(starts_with(n.id(), "Qm"), "id " << n.id());
+
+    check_usable(ios, n);
+}
@@ -0,0 +1,96 @@
+// Several online nodes in one process: each registers its metrics and loads
+// the plugins without clashing with the others, and they exchange content
+// over loopback.
+
+#define BOOST_TEST_MODULE multi_node
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using asio_ipfs::node;
+
+static node::config online_config()
+{
+    node::config cfg;
+    cfg.identity  = node::identity_type::ed25519;
+    cfg.bootstrap = false;
+    return cfg;
+}
+
+static bool starts_with(const string& s, const string& prefix)
+{
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+static string loopback_address(const node& n)
+{
+    for (auto& addr : n.swarm_addresses()) {
+        if (starts_with(addr, "/ip4/127.0.0.1/")) return addr;
+    }
+    return string();
+}
+
+BOOST_AUTO_TEST_CASE(two_nodes)
+{
+    temp_repo repo1, repo2;
+    asio::io_service ios;
+
+    // Both serve the HTTP API, so both register their Prometheus metrics.
+    node n1(ios, repo1.path(), online_config());
+    node n2(ios, repo2.path(), online_config());
+
+    BOOST_REQUIRE_NE(n1.id(), n2.id());
+
+    const string addr = loopback_address(n2);
+    BOOST_REQUIRE_MESSAGE(!addr.empty(), "n2 doesn't listen on loopback");
+
+    const string data = "multi node test";
+    string got;
+
+    n1.connect(addr, [&] (sys::error_code ec) {
+            BOOST_REQUIRE_MESSAGE(!ec, "connect: " << ec.message());
+
+            n2.add(data, [&] (sys::error_code ec, string cid) {
+                    BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+
+                    n1.cat(cid, [&] (sys::error_code ec, string d) {
+                            BOOST_REQUIRE_MESSAGE(!ec, "cat: " << ec.message());
+                            got = std::move(d);
+                        });
+                });
+        });
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(got, data);
+}
+
+BOOST_AUTO_TEST_CASE(three_nodes_built)
+{
+    temp_repo repos[3];
+    asio::io_service ios;
+    std::unique_ptr<node> nodes[3];
+
+    for (size_t i = 0; i != 3; ++i) {
+        node::build(ios, repos[i].path(), online_config(),
+            [&, i] (sys::error_code ec, std::unique_ptr<node> n) {
+                BOOST_REQUIRE_MESSAGE(!ec, "build " << i << ": " << ec.message());
+                nodes[i] = std::move(n);
+            });
+    }
+
+    ios.run();
+    ios.reset();
+
+    for (auto& n : nodes) BOOST_REQUIRE(n);
+
+    BOOST_CHECK_NE(nodes[0]->id(), nodes[1]->id());
+    BOOST_CHECK_NE(nodes[1]->id(), nodes[2]->id());
+    BOOST_CHECK_NE(nodes[0]->id(), nodes[2]->id());
+}
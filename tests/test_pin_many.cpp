@@ -0,0 +1,219 @@
+// `pin_many` and `unpin_many`, which either pin (or unpin) all of the CIDs
+// given or, on failure, none of them. Whether a CID is pinned is told by
+// whether unpinning it succeeds.
+
+#define BOOST_TEST_MODULE pin_many
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using std::vector;
+using asio_ipfs::node;
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+// Content whose chunks all differ, so none of its blocks are deduplicated.
+static string distinct_data(size_t size)
+{
+    string ret;
+    for (size_t i = 0; ret.size() < size; ++i) ret += std::to_string(i) + ' ';
+    ret.resize(size);
+    return ret;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    // Offline, content the node doesn't have can't be fetched.
+    const string missing = asio_ipfs::calculate_cid("pin_many test, never added");
+
+    string add(const string& data) {
+        string ret;
+
+        n.add(data, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code pin_many(const vector<string>& cids, node::pin_options o = {}) {
+        sys::error_code ret;
+
+        n.pin_many(cids, std::move(o), [&] (sys::error_code ec) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code unpin_many(const vector<string>& cids) {
+        sys::error_code ret;
+
+        n.unpin_many(cids, [&] (sys::error_code ec) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code pin(const string& cid) {
+        sys::error_code ret;
+
+        n.pin(cid, [&] (sys::error_code ec) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    bool pinned(const string& cid) {
+        sys::error_code ret;
+
+        n.unpin(cid, [&] (sys::error_code ec) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return !ret;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(pin_many, fixture)
+
+BOOST_AUTO_TEST_CASE(pins_all)
+{
+    vector<string> cids{add("pin_many 1"), add("pin_many 2"), add("pin_many 3")};
+
+    BOOST_REQUIRE(!pin_many(cids));
+
+    for (auto& cid : cids) BOOST_CHECK(pinned(cid));
+}
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+    BOOST_CHECK(!pin_many({}));
+    BOOST_CHECK(!unpin_many({}));
+}
+
+BOOST_AUTO_TEST_CASE(rollback)
+{
+    string a = add("pin_many rollback 1");
+    string b = add("pin_many rollback 2");
+
+    BOOST_CHECK(pin_many({a, missing, b}));
+
+    BOOST_CHECK(!pinned(a));
+    BOOST_CHECK(!pinned(b));
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::pin_many].failed, 1u);
+}
+
+// A failed `pin_many` doesn't take away pins which were there before.
+BOOST_AUTO_TEST_CASE(keeps_existing_pins)
+{
+    string a = add("pin_many existing 1");
+    string b = add("pin_many existing 2");
+
+    BOOST_REQUIRE(!pin(a));
+    BOOST_CHECK(pin_many({a, b, missing}));
+
+    BOOST_CHECK(pinned(a));
+    BOOST_CHECK(!pinned(b));
+}
+
+BOOST_AUTO_TEST_CASE(progress)
+{
+    // A root and three leaves.
+    const string big = distinct_data(600 * 1024);
+    vector<string> cids{add("pin_many progress"), add(big)};
+
+    vector<node::pin_progress> reports;
+    bool done = false;
+
+    node::pin_options o;
+    o.parallelism = 1;
+    o.on_progress = [&] (const node::pin_progress& p) {
+        BOOST_CHECK(!done);
+        reports.push_back(p);
+    };
+
+    n.pin_many(cids, std::move(o), [&] (sys::error_code ec) {
+            BOOST_CHECK(!ec);
+            done = true;
+        });
+
+    ios.run();
+
+    BOOST_REQUIRE(done);
+    BOOST_REQUIRE(!reports.empty());
+
+    for (size_t i = 0; i < reports.size(); ++i) {
+        BOOST_CHECK_EQUAL(reports[i].cids_total, cids.size());
+        if (i == 0) continue;
+        BOOST_CHECK_GE(reports[i].blocks,    reports[i - 1].blocks);
+        BOOST_CHECK_GE(reports[i].bytes,     reports[i - 1].bytes);
+        BOOST_CHECK_GE(reports[i].cids_done, reports[i - 1].cids_done);
+    }
+
+    // The last one comes in before the handler and covers everything.
+    auto& last = reports.back();
+    BOOST_CHECK_EQUAL(last.cids_done, cids.size());
+    BOOST_CHECK_GE(last.blocks, 4u);
+    BOOST_CHECK_GE(last.bytes, big.size());
+}
+
+BOOST_AUTO_TEST_CASE(progress_on_failure)
+{
+    string a = add("pin_many progress failure");
+    bool reported = false;
+
+    node::pin_options o;
+    o.on_progress = [&] (const node::pin_progress& p) {
+        BOOST_CHECK_EQUAL(p.cids_total, 2u);
+        BOOST_CHECK_LT(p.cids_done, 2u);
+        reported = true;
+    };
+
+    BOOST_CHECK(pin_many({a, missing}, std::move(o)));
+    BOOST_CHECK(reported);
+}
+
+BOOST_AUTO_TEST_CASE(unpin_all)
+{
+    vector<string> cids{add("unpin_many 1"), add("unpin_many 2")};
+
+    BOOST_REQUIRE(!pin_many(cids));
+    BOOST_REQUIRE(!unpin_many(cids));
+
+    for (auto& cid : cids) BOOST_CHECK(!pinned(cid));
+}
+
+// One of them not being pinned fails the lot, the others stay pinned.
+BOOST_AUTO_TEST_CASE(unpin_rollback)
+{
+    string a = add("unpin_many rollback 1");
+    string b = add("unpin_many rollback 2");
+
+    BOOST_REQUIRE(!pin(a));
+    BOOST_CHECK(unpin_many({a, b}));
+
+    BOOST_CHECK(pinned(a));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
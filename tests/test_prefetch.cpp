@@ -0,0 +1,178 @@
+// `prefetch` of content the node has, or doesn't have and can't get: it
+// reports the size of the DAG without handing over any of its content, and
+// optionally pins it.
+
+#define BOOST_TEST_MODULE prefetch
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using asio_ipfs::node;
+
+static const size_t chunk_size = 256 * 1024;
+
+// Content whose chunks all differ, so none of its blocks are deduplicated.
+static string distinct_data(size_t size)
+{
+    string ret;
+    for (size_t i = 0; ret.size() < size; ++i) ret += std::to_string(i) + ' ';
+    ret.resize(size);
+    return ret;
+}
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    string add(const string& data) {
+        string ret;
+
+        n.add(data, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code prefetch( const string& cid
+                            , node::prefetch_options o
+                            , node::prefetch_result& result) {
+        sys::error_code ret;
+        std::function<void()> cancel;
+
+        n.prefetch(cid, o, cancel, [&] (sys::error_code ec, node::prefetch_result r) {
+                ret = ec;
+                result = r;
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code unpin(const string& cid) {
+        sys::error_code ret;
+
+        n.unpin(cid, [&] (sys::error_code ec) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(prefetch, fixture)
+
+BOOST_AUTO_TEST_CASE(single_block)
+{
+    string cid = add("prefetch test");
+    node::prefetch_result r;
+
+    BOOST_REQUIRE(!prefetch(cid, {}, r));
+
+    BOOST_CHECK_EQUAL(r.blocks, 1u);
+    BOOST_CHECK_GE(r.bytes, string("prefetch test").size());
+}
+
+// A root linking to three leaves, whose blocks hold the content plus a
+// little UnixFS framing.
+BOOST_AUTO_TEST_CASE(several_blocks)
+{
+    const string data = distinct_data(3 * chunk_size);
+    string cid = add(data);
+    node::prefetch_result r;
+
+    node::prefetch_options o;
+    o.parallelism = 2;
+
+    BOOST_REQUIRE(!prefetch(cid, o, r));
+
+    BOOST_CHECK_EQUAL(r.blocks, 4u);
+    BOOST_CHECK_GE(r.bytes, data.size());
+    BOOST_CHECK_LT(r.bytes, data.size() + 1024);
+
+    auto s = n.get_stats()[node::op_type::prefetch];
+    BOOST_CHECK_EQUAL(s.succeeded, 1u);
+    // None of the content is handed over.
+    BOOST_CHECK_EQUAL(s.bytes_in, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(pin)
+{
+    string cid = add("prefetch pin test");
+    node::prefetch_result r;
+
+    // Content added with `add` isn't pinned.
+    BOOST_REQUIRE(!prefetch(cid, {}, r));
+    BOOST_CHECK(unpin(cid));
+
+    node::prefetch_options o;
+    o.pin = true;
+
+    BOOST_REQUIRE(!prefetch(cid, o, r));
+    BOOST_CHECK(!unpin(cid));
+}
+
+// Offline, content the node doesn't have can't be fetched.
+BOOST_AUTO_TEST_CASE(missing)
+{
+    string cid = asio_ipfs::calculate_cid("prefetch test, never added");
+    node::prefetch_result r;
+
+    node::prefetch_options o;
+    o.pin = true;
+
+    BOOST_CHECK(prefetch(cid, o, r));
+    BOOST_CHECK(unpin(cid));
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::prefetch].failed, 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Online but without peers, fetching missing content waits until cancelled.
+BOOST_AUTO_TEST_CASE(cancel)
+{
+    temp_repo repo;
+    asio::io_service ios;
+
+    node::config cfg;
+    cfg.identity  = node::identity_type::ed25519;
+    cfg.bootstrap = false;
+    cfg.http_api  = false;
+
+    node n(ios, repo.path(), cfg);
+
+    string cid = asio_ipfs::calculate_cid("prefetch cancel test, never added");
+    std::function<void()> cancel;
+    sys::error_code result;
+
+    n.prefetch(cid, {}, cancel, [&] (sys::error_code ec, node::prefetch_result) {
+            result = ec;
+        });
+
+    asio::steady_timer timer(ios, std::chrono::milliseconds(200));
+    timer.async_wait([&] (sys::error_code) { cancel(); });
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(result, asio::error::operation_aborted);
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::prefetch].aborted, 1u);
+}
@@ -0,0 +1,217 @@
+// Debounced `publish`: calls close together collapse into one publish of
+// the newest CID, which completes all of them. What got published is told
+// by resolving the node's own id, bypassing the resolve cache.
+
+#define BOOST_TEST_MODULE publish
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using std::vector;
+using asio_ipfs::node;
+using std::chrono::hours;
+using std::chrono::milliseconds;
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    cfg.identity = node::identity_type::ed25519;
+    return cfg;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    // Resolving goes down to the node the record points to, the node has
+    // to have it.
+    const string cid1 = add("publish test 1");
+    const string cid2 = add("publish test 2");
+    const string cid3 = add("publish test 3");
+
+    string add(const string& data) {
+        string ret;
+
+        n.add(data, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code resolve(string& cid) {
+        sys::error_code ret;
+
+        n.resolve(n.id(), true, [&] (sys::error_code ec, string c) {
+                ret = ec;
+                cid = std::move(c);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    string published() {
+        string cid;
+        BOOST_REQUIRE(!resolve(cid));
+        return cid;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(publish, fixture)
+
+BOOST_AUTO_TEST_CASE(collapse)
+{
+    vector<string> order;
+    vector<sys::error_code> results(3);
+
+    n.publish(cid1, hours(1), [&] (sys::error_code ec) { order.push_back(cid1); results[0] = ec; });
+    n.publish(cid2, hours(1), [&] (sys::error_code ec) { order.push_back(cid2); results[1] = ec; });
+    n.publish(cid3, hours(1), [&] (sys::error_code ec) { order.push_back(cid3); results[2] = ec; });
+
+    ios.run();
+    ios.reset();
+
+    BOOST_REQUIRE_EQUAL(order.size(), 3u);
+    for (auto& ec : results) BOOST_CHECK(!ec);
+
+    BOOST_CHECK_EQUAL(published(), cid3);
+
+    auto s = n.get_stats()[node::op_type::publish];
+    BOOST_CHECK_EQUAL(s.started, 3u);
+    BOOST_CHECK_EQUAL(s.succeeded, 3u);
+}
+
+// Calls further apart than the debounce window are published one by one.
+BOOST_AUTO_TEST_CASE(apart)
+{
+    sys::error_code result;
+
+    n.publish(cid1, hours(1), [&] (sys::error_code ec) { result = ec; });
+    ios.run();
+    ios.reset();
+
+    BOOST_REQUIRE(!result);
+    BOOST_CHECK_EQUAL(published(), cid1);
+
+    n.publish(cid2, hours(1), [&] (sys::error_code ec) { result = ec; });
+    ios.run();
+    ios.reset();
+
+    BOOST_REQUIRE(!result);
+    BOOST_CHECK_EQUAL(published(), cid2);
+}
+
+// Cancelling a superseded call only completes that call, the newest CID
+// still gets published.
+BOOST_AUTO_TEST_CASE(cancel_superseded)
+{
+    std::function<void()> cancel;
+    sys::error_code first, second;
+
+    n.publish(cid1, hours(1), cancel, [&] (sys::error_code ec) { first = ec; });
+    n.publish(cid2, hours(1), [&] (sys::error_code ec) { second = ec; });
+
+    cancel();
+
+    ios.run();
+    ios.reset();
+
+    BOOST_CHECK_EQUAL(first, asio::error::operation_aborted);
+    BOOST_CHECK(!second);
+    BOOST_CHECK_EQUAL(published(), cid2);
+}
+
+// Nothing is published if every call of the window got cancelled.
+BOOST_AUTO_TEST_CASE(cancel_all)
+{
+    std::function<void()> cancel;
+    sys::error_code result;
+
+    n.publish(cid1, hours(1), cancel, [&] (sys::error_code ec) { result = ec; });
+
+    cancel();
+
+    ios.run();
+    ios.reset();
+
+    BOOST_CHECK_EQUAL(result, asio::error::operation_aborted);
+
+    string cid;
+    BOOST_CHECK(resolve(cid));
+}
+
+BOOST_AUTO_TEST_CASE(too_short)
+{
+    bool called = false;
+    sys::error_code result;
+
+    n.publish(cid1, milliseconds(999), [&] (sys::error_code ec) {
+            called = true;
+            result = ec;
+        });
+
+    // Not from within the call.
+    BOOST_CHECK(!called);
+
+    ios.run();
+
+    BOOST_CHECK(called);
+    BOOST_CHECK_EQUAL(result, asio::error::invalid_argument);
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::publish].started, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Without a debounce window calls still complete, and the last one wins.
+BOOST_AUTO_TEST_CASE(no_debounce)
+{
+    temp_repo repo;
+    asio::io_service ios;
+
+    node::config cfg = offline_config();
+    cfg.publish_debounce = 0;
+
+    node n(ios, repo.path(), cfg);
+
+    string cid1, cid2;
+
+    n.add("no debounce test 1", [&] (sys::error_code, string c) { cid1 = std::move(c); });
+    n.add("no debounce test 2", [&] (sys::error_code, string c) { cid2 = std::move(c); });
+    ios.run();
+    ios.reset();
+
+    size_t done = 0;
+
+    n.publish(cid1, hours(1), [&] (sys::error_code ec) { BOOST_CHECK(!ec); ++done; });
+    ios.run();
+    ios.reset();
+
+    n.publish(cid2, hours(1), [&] (sys::error_code ec) { BOOST_CHECK(!ec); ++done; });
+    ios.run();
+    ios.reset();
+
+    BOOST_CHECK_EQUAL(done, 2u);
+
+    string cid;
+    n.resolve(n.id(), true, [&] (sys::error_code ec, string c) {
+            BOOST_CHECK(!ec);
+            cid = std::move(c);
+        });
+    ios.run();
+
+    BOOST_CHECK_EQUAL(cid, cid2);
+}
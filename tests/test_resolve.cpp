@@ -0,0 +1,158 @@
+// The cache of resolved IPNS names. An offline node keeps the records it
+// publishes locally, so it can resolve its own id.
+
+#define BOOST_TEST_MODULE resolve
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using asio_ipfs::node;
+using std::chrono::seconds;
+using std::chrono::hours;
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    cfg.identity = node::identity_type::ed25519;
+    return cfg;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    // Resolving goes down to the node the record points to, the node has
+    // to have it.
+    const string cid1 = add("resolve test 1");
+    const string cid2 = add("resolve test 2");
+
+    string add(const string& data) {
+        string ret;
+
+        n.add(data, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    void publish(const string& cid, std::chrono::steady_clock::duration d = hours(1)) {
+        n.publish(cid, d, [&] (sys::error_code ec) {
+                BOOST_REQUIRE_MESSAGE(!ec, "publish: " << ec.message());
+            });
+
+        ios.run();
+        ios.reset();
+    }
+
+    sys::error_code resolve(bool fresh, string& cid) {
+        sys::error_code ret;
+
+        n.resolve(n.id(), fresh, [&] (sys::error_code ec, string c) {
+                ret = ec;
+                cid = std::move(c);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    string resolve(bool fresh = false) {
+        string cid;
+        BOOST_REQUIRE(!resolve(fresh, cid));
+        return cid;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(resolve, fixture)
+
+BOOST_AUTO_TEST_CASE(miss_then_hit)
+{
+    publish(cid1);
+
+    BOOST_CHECK_EQUAL(resolve(), cid1);
+
+    auto s = n.get_resolve_cache_stats();
+    BOOST_CHECK_EQUAL(s.misses, 1u);
+    BOOST_CHECK_EQUAL(s.hits, 0u);
+
+    BOOST_CHECK_EQUAL(resolve(), cid1);
+    BOOST_CHECK_EQUAL(resolve(), cid1);
+
+    s = n.get_resolve_cache_stats();
+    BOOST_CHECK_EQUAL(s.misses, 1u);
+    BOOST_CHECK_EQUAL(s.hits, 2u);
+    BOOST_CHECK_EQUAL(s.stale_hits, 0u);
+    BOOST_CHECK_EQUAL(s.refreshes, 0u);
+}
+
+// Within its TTL the cached answer is given even once a newer record got
+// published. A fresh resolution gets the newer one, and updates the cache.
+BOOST_AUTO_TEST_CASE(fresh)
+{
+    publish(cid1);
+    BOOST_REQUIRE_EQUAL(resolve(), cid1);
+
+    publish(cid2);
+    BOOST_CHECK_EQUAL(resolve(), cid1);
+
+    auto before = n.get_resolve_cache_stats();
+
+    BOOST_CHECK_EQUAL(resolve(true), cid2);
+
+    // Not looked up in the cache at all.
+    auto after = n.get_resolve_cache_stats();
+    BOOST_CHECK_EQUAL(after.hits, before.hits);
+    BOOST_CHECK_EQUAL(after.misses, before.misses);
+
+    BOOST_CHECK_EQUAL(resolve(), cid2);
+    BOOST_CHECK_EQUAL(n.get_resolve_cache_stats().hits, before.hits + 1);
+}
+
+BOOST_AUTO_TEST_CASE(unknown)
+{
+    string cid;
+
+    n.resolve("QmaCpDMGvV2BGHeYERUEnRQAwe3N8SzbUtfsmvsqQLuvuJ",
+        [&] (sys::error_code ec, string c) {
+            BOOST_CHECK(ec);
+            cid = std::move(c);
+        });
+
+    ios.run();
+
+    BOOST_CHECK(cid.empty());
+    BOOST_CHECK_EQUAL(n.get_resolve_cache_stats().misses, 1u);
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::resolve].failed, 1u);
+}
+
+// Cached answers aren't given past the expiry of their record.
+BOOST_AUTO_TEST_CASE(expired)
+{
+    publish(cid1, seconds(1));
+    BOOST_REQUIRE_EQUAL(resolve(), cid1);
+
+    asio::steady_timer timer(ios, std::chrono::milliseconds(1500));
+    timer.async_wait([] (sys::error_code) {});
+    ios.run();
+    ios.reset();
+
+    string cid;
+    BOOST_CHECK(resolve(false, cid));
+    BOOST_CHECK_EQUAL(n.get_resolve_cache_stats().misses, 2u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,207 @@
+// Per operation counters and latency histograms of `get_stats`, and the
+// bucketing behind the histograms.
+
+#define BOOST_TEST_MODULE stats
+#include <boost/test/included/unit_test.hpp>
+
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using asio_ipfs::node;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using histogram = node::latency_histogram;
+
+static void record(histogram& h, microseconds d)
+{
+    ++h.buckets[histogram::bucket_index(d)];
+    ++h.count;
+    h.sum += d;
+}
+
+BOOST_AUTO_TEST_SUITE(buckets)
+
+BOOST_AUTO_TEST_CASE(small_values_exact)
+{
+    for (size_t i = 0; i < 8; ++i) {
+        BOOST_CHECK_EQUAL(histogram::bucket_index(microseconds(i)), i);
+        BOOST_CHECK_EQUAL(histogram::lower_bound(i).count(), int64_t(i));
+    }
+
+    BOOST_CHECK_EQUAL(histogram::bucket_index(microseconds(-5)), 0u);
+}
+
+// Every value falls within the bounds of its bucket, and buckets are at
+// most an eighth of their lower bound wide.
+BOOST_AUTO_TEST_CASE(bounds)
+{
+    size_t last = 0;
+
+    for (int64_t v = 1; v < (int64_t(1) << 32); v += v / 7 + 1) {
+        size_t i = histogram::bucket_index(microseconds(v));
+
+        BOOST_REQUIRE_LT(i, histogram::bucket_count);
+        BOOST_REQUIRE_GE(i, last);
+        BOOST_REQUIRE_LE(histogram::lower_bound(i).count(), v);
+        BOOST_REQUIRE_GT(histogram::lower_bound(i + 1).count(), v);
+
+        auto width = histogram::lower_bound(i + 1) - histogram::lower_bound(i);
+        BOOST_REQUIRE_LE(width.count() * 8, std::max<int64_t>(8, histogram::lower_bound(i).count()));
+
+        last = i;
+    }
+
+    // Boundaries themselves start their bucket.
+    for (size_t i = 0; i < histogram::bucket_count; ++i) {
+        BOOST_REQUIRE_EQUAL(histogram::bucket_index(histogram::lower_bound(i)), i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(last_bucket)
+{
+    const size_t last = histogram::bucket_count - 1;
+
+    BOOST_CHECK_EQUAL(histogram::bucket_index(microseconds(int64_t(1) << 32)), last);
+    BOOST_CHECK_EQUAL(histogram::bucket_index(std::chrono::hours(24 * 365)), last);
+    BOOST_CHECK_EQUAL(histogram::bucket_index(microseconds::max()), last);
+}
+
+BOOST_AUTO_TEST_CASE(percentile)
+{
+    histogram h;
+
+    BOOST_CHECK_EQUAL(h.percentile(0.5).count(), 0);
+    BOOST_CHECK_EQUAL(h.mean().count(), 0);
+
+    for (int i = 1; i <= 100; ++i) record(h, milliseconds(i));
+
+    // Upper bounds of the right buckets, so no less than the exact value
+    // and at most an eighth more.
+    for (int p : {1, 10, 50, 90, 99, 100}) {
+        int64_t exact = microseconds(milliseconds(p)).count();
+        int64_t got = h.percentile(p / 100.0).count();
+
+        BOOST_CHECK_GT(got, exact);
+        BOOST_CHECK_LE(got, exact + exact / 8);
+    }
+
+    // Out of range ranks are clamped to the smallest and the largest.
+    auto first = histogram::bucket_index(milliseconds(1)) + 1;
+    BOOST_CHECK_EQUAL(h.percentile(0).count(), histogram::lower_bound(first).count());
+    BOOST_CHECK_EQUAL(h.percentile(2).count(), h.percentile(1).count());
+
+    BOOST_CHECK_EQUAL(h.mean().count(), 50500);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+struct fixture {
+    temp_repo repo;
+    asio::io_service ios;
+    node n{ios, repo.path(), offline_config()};
+
+    string add(const string& data) {
+        string ret;
+
+        n.add(data, [&] (sys::error_code ec, string cid) {
+                BOOST_REQUIRE_MESSAGE(!ec, "add: " << ec.message());
+                ret = std::move(cid);
+            });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+
+    sys::error_code cat(const string& cid) {
+        sys::error_code ret;
+
+        n.cat(cid, [&] (sys::error_code ec, string) { ret = ec; });
+
+        ios.run();
+        ios.reset();
+        return ret;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(node_stats, fixture)
+
+BOOST_AUTO_TEST_CASE(initially_zero)
+{
+    auto s = n.get_stats();
+
+    for (size_t i = 0; i < node::op_type_count; ++i) {
+        if (static_cast<node::op_type>(i) == node::op_type::build) continue;
+        BOOST_CHECK_EQUAL(s.ops[i].started, 0u);
+        BOOST_CHECK_EQUAL(s.ops[i].latency.count, 0u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(counters)
+{
+    const string data = "stats test";
+    string cid = add(data);
+
+    BOOST_REQUIRE(!cat(cid));
+    BOOST_REQUIRE(!cat(cid));
+    BOOST_REQUIRE(cat(asio_ipfs::calculate_cid("stats test, never added")));
+
+    auto s = n.get_stats();
+
+    auto& a = s[node::op_type::add];
+    BOOST_CHECK_EQUAL(a.started, 1u);
+    BOOST_CHECK_EQUAL(a.succeeded, 1u);
+    BOOST_CHECK_EQUAL(a.bytes_out, data.size());
+    BOOST_CHECK_EQUAL(a.bytes_in, 0u);
+    BOOST_CHECK_EQUAL(a.latency.count, 1u);
+
+    auto& c = s[node::op_type::cat];
+    BOOST_CHECK_EQUAL(c.started, 3u);
+    BOOST_CHECK_EQUAL(c.succeeded, 2u);
+    BOOST_CHECK_EQUAL(c.failed, 1u);
+    BOOST_CHECK_EQUAL(c.aborted, 0u);
+    BOOST_CHECK_EQUAL(c.in_flight, 0u);
+    BOOST_CHECK_EQUAL(c.bytes_in, 2 * data.size());
+    BOOST_CHECK_EQUAL(c.latency.count, 3u);
+    BOOST_CHECK_GT(c.latency.sum.count(), 0);
+
+    // Each of them waited for the io_service once.
+    BOOST_CHECK_EQUAL(s.completion_delay.count, 4u);
+
+    BOOST_CHECK_EQUAL(s[node::op_type::pin].started, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(in_flight)
+{
+    string cid = add("stats in flight test");
+
+    n.cat(cid, [] (sys::error_code, string) {});
+
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::cat].in_flight, 1u);
+
+    ios.run();
+
+    BOOST_CHECK_EQUAL(n.get_stats()[node::op_type::cat].in_flight, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_CASE(op_type_names)
+{
+    BOOST_CHECK_EQUAL(node::op_type_name(node::op_type::build), "build");
+    BOOST_CHECK_EQUAL(node::op_type_name(node::op_type::cat_range), "cat_range");
+    BOOST_CHECK_EQUAL(node::op_type_name(node::op_type::block_get), "block_get");
+}
@@ -0,0 +1,209 @@
+// One node shared by many clients, each running on a strand of its own, with
+// the io_service run by several threads. Operations get started, completed,
+// cancelled and their readers and writers destroyed concurrently from all of
+// them. Best run under ThreadSanitizer.
+
+#define BOOST_TEST_MODULE threads
+#include <boost/test/included/unit_test.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <asio_ipfs.h>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/spawn.hpp>
+#include <boost/asio/strand.hpp>
+#if BOOST_VERSION >= 106600
+#   include <boost/asio/post.hpp>
+#endif
+#include "temp_repo.h"
+
+namespace asio = boost::asio;
+namespace sys  = boost::system;
+
+using std::string;
+using std::vector;
+using asio_ipfs::node;
+using Cancel = std::function<void()>;
+
+#if BOOST_VERSION >= 106600
+using Strand = asio::strand<asio::io_service::executor_type>;
+
+template<class F> static void post(Strand& s, F f) { asio::post(s, std::move(f)); }
+#else
+using Strand = asio::io_service::strand;
+
+template<class F> static void post(Strand& s, F f) { s.post(std::move(f)); }
+#endif
+
+static const size_t thread_count = 4;
+static const size_t client_count = 16;
+static const size_t round_count  = 20;
+
+// Boost.Test's assertions may only be used from the main thread, so the
+// clients collect what went wrong here.
+struct failures {
+    std::mutex mutex;
+    vector<string> list;
+
+    void add(size_t client, size_t round, const string& what) {
+        std::lock_guard<std::mutex> lock(mutex);
+        list.push_back( "client " + std::to_string(client)
+                      + " round " + std::to_string(round)
+                      + ": " + what);
+    }
+};
+
+static node::config offline_config()
+{
+    node::config cfg;
+    cfg.online   = false;
+    cfg.http_api = false;
+    return cfg;
+}
+
+// Different for every client and round, some of it spanning several chunks.
+static string make_content(size_t client, size_t round)
+{
+    string ret = "client " + std::to_string(client)
+               + " round " + std::to_string(round) + "\n";
+
+    size_t size = (client * round_count + round) % 7 * 100 * 1024;
+
+    ret.reserve(ret.size() + size);
+
+    for (size_t i = 0; i < size; ++i) {
+        ret.push_back(char((i * 31 + client * 7 + round) % 251));
+    }
+
+    return ret;
+}
+
+static string read_all(node::reader& r, asio::yield_context yield, sys::error_code& ec)
+{
+    string ret;
+    // Coroutine stacks are small.
+    vector<char> buf(64 * 1024);
+
+    while (true) {
+        size_t n = r.async_read_some(asio::buffer(buf), yield[ec]);
+        ret.append(buf.data(), n);
+        if (ec) break;
+    }
+
+    if (ec == asio::error::eof) ec = sys::error_code();
+    return ret;
+}
+
+static void run_client( node& n
+                      , Strand& strand
+                      , size_t client
+                      , failures& failed
+                      , std::atomic<size_t>& rounds_done
+                      , asio::yield_context yield)
+{
+    for (size_t round = 0; round < round_count; ++round) {
+        auto fail = [&] (const string& what) { failed.add(client, round, what); };
+
+        sys::error_code ec;
+        const string content = make_content(client, round);
+        const string expected = asio_ipfs::calculate_cid(content);
+
+        // Write the content in two pieces.
+        auto w = n.add_stream();
+        size_t half = content.size() / 2;
+        w.async_write(asio::buffer(content.data(), half), yield[ec]);
+        if (ec) { fail("write: " + ec.message()); continue; }
+        w.async_write(asio::buffer(content.data() + half, content.size() - half), yield[ec]);
+        if (ec) { fail("write: " + ec.message()); continue; }
+        string cid = w.async_finish(yield[ec]);
+        if (ec) { fail("finish: " + ec.message()); continue; }
+        if (cid != expected) fail("add_stream gave " + cid + ", expected " + expected);
+
+        cid = n.add(content, yield[ec]);
+        if (ec) { fail("add: " + ec.message()); continue; }
+        if (cid != expected) fail("add gave " + cid + ", expected " + expected);
+
+        string got = n.cat(cid, yield[ec]);
+        if (ec) { fail("cat: " + ec.message()); continue; }
+        if (got != content) fail("cat returned different content");
+
+        {
+            auto r = n.cat_stream(cid);
+            got = read_all(r, yield, ec);
+            if (ec) { fail("read: " + ec.message()); continue; }
+            if (got != content) fail("cat_stream returned different content");
+        }
+
+        // Cancel from the strand the completion runs in. Either may come
+        // first.
+        auto cancel = std::make_shared<Cancel>();
+        post(strand, [cancel] { (*cancel)(); });
+        got = n.cat(cid, *cancel, yield[ec]);
+        if (ec && ec != asio::error::operation_aborted) {
+            fail("cancelled cat: " + ec.message());
+        }
+        if (!ec && got != content) fail("cancelled cat returned different content");
+
+        // Readers and writers dropped part way through, the writer after a
+        // cancelled write.
+        {
+            auto r = n.cat_stream(cid);
+            char buf[1024];
+            r.async_read_some(asio::buffer(buf), yield[ec]);
+            if (ec) fail("partial read: " + ec.message());
+        }
+        {
+            auto w = n.add_stream();
+            auto cancel = std::make_shared<Cancel>();
+            post(strand, [cancel] { (*cancel)(); });
+            w.async_write(asio::buffer(content), *cancel, yield[ec]);
+            if (ec && ec != asio::error::operation_aborted) {
+                fail("cancelled write: " + ec.message());
+            }
+        }
+        {
+            auto r = n.cat_stream(cid);
+        }
+
+        ++rounds_done;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_clients)
+{
+    temp_repo repo;
+    asio::io_service ios;
+    node n(ios, repo.path(), offline_config());
+
+    failures failed;
+    std::atomic<size_t> rounds_done{0};
+
+    vector<std::unique_ptr<Strand>> strands;
+
+    for (size_t c = 0; c < client_count; ++c) {
+#if BOOST_VERSION >= 106600
+        strands.emplace_back(new Strand(ios.get_executor()));
+#else
+        strands.emplace_back(new Strand(ios));
+#endif
+        auto strand = strands.back().get();
+
+        asio::spawn(*strand, [&, strand, c] (asio::yield_context yield) {
+                run_client(n, *strand, c, failed, rounds_done, yield);
+            });
+    }
+
+    vector<std::thread> threads;
+
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&] { ios.run(); });
+    }
+
+    for (auto& t : threads) t.join();
+
+    for (auto& f : failed.list) BOOST_ERROR(f);
+
+    BOOST_CHECK_EQUAL(rounds_done, client_count * round_count);
+}